@@ -0,0 +1,1185 @@
+/* Benchmarks for the bitmap, hash table and list code.
+
+   Usage: bench [-l] [SUITE]...
+
+   Runs each named SUITE, or every suite if none is named, and
+   prints one line per case with the time it took.  Where a suite
+   compares a fast path with the simple path it replaced, the
+   line shows both and the speedup.  With -l, suites also run
+   their largest sizes, which take much longer and need up to a
+   few GB of memory.
+
+   The Makefile builds without optimization by default, so for
+   meaningful numbers build with, for example,
+   `make clean; make bench CFLAGS=-O2'. */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bitmap.h"
+#include "chash.h"
+#include "hash.h"
+#include "list.h"
+#include "ohash.h"
+
+/* Run the largest sizes too? */
+static bool large;
+
+/* Results are stored here so that the compiler cannot drop the
+   work that computes them. */
+static volatile size_t sink;
+
+/* Returns the current time, in seconds. */
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Prints the times SLOW and FAST, in seconds, of the simple and
+   fast paths of the case described by WHAT. */
+static void
+report (const char *what, double slow, double fast)
+{
+  printf ("  %-40s %10.3f ms %10.3f ms %8.1fx\n",
+          what, slow * 1e3, fast * 1e3, fast > 0 ? slow / fast : 0.0);
+}
+
+/* Prints the times SLOW and FAST, in seconds, of the simple and
+   fast paths of the case described by WHAT, each of which did
+   CNT operations, in nanoseconds per operation. */
+static void
+report_per_op (const char *what, double slow, double fast, size_t cnt)
+{
+  printf ("  %-40s %10.1f ns %10.1f ns %8.1fx\n",
+          what, slow * 1e9 / cnt, fast * 1e9 / cnt,
+          fast > 0 ? slow / fast : 0.0);
+}
+
+/* Returns a random number from SEED, for shuffling arrays that
+   may have more elements than RAND_MAX. */
+static size_t
+random_index (unsigned *seed)
+{
+  return ((size_t) rand_r (seed) << 31) ^ rand_r (seed);
+}
+
+/* Bitmap range operations.
+
+   Compares bitmap_count(), bitmap_contains() and
+   bitmap_set_multiple(), which work a whole element at a time,
+   with the bit-at-a-time loops they replaced. */
+
+/* Bit-at-a-time bitmap_count(). */
+static size_t
+count_per_bit (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Bit-at-a-time bitmap_contains(). */
+static bool
+contains_per_bit (const struct bitmap *b, size_t start, size_t cnt,
+                  bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+/* Bit-at-a-time bitmap_set_multiple(). */
+static void
+set_multiple_per_bit (struct bitmap *b, size_t start, size_t cnt,
+                      bool value)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    bitmap_set (b, start + i, value);
+}
+
+/* Times the range operations on a 16M-bit map. */
+static void
+bench_bitmap (void)
+{
+  const size_t bit_cnt = (size_t) 1 << 24;
+  struct bitmap *b = bitmap_create (bit_cnt);
+  double t0, t1, t2;
+
+  if (b == NULL)
+    {
+      printf ("  out of memory\n");
+      return;
+    }
+  printf ("  %-40s %13s %13s\n", "16M-bit map", "per-bit", "word");
+
+  t0 = now ();
+  set_multiple_per_bit (b, 3, bit_cnt - 6, true);
+  set_multiple_per_bit (b, 5, bit_cnt / 2, false);
+  t1 = now ();
+  bitmap_set_multiple (b, 3, bit_cnt - 6, true);
+  bitmap_set_multiple (b, 5, bit_cnt / 2, false);
+  t2 = now ();
+  report ("bitmap_set_multiple", t1 - t0, t2 - t1);
+
+  t0 = now ();
+  sink = count_per_bit (b, 1, bit_cnt - 2, true);
+  t1 = now ();
+  sink = bitmap_count (b, 1, bit_cnt - 2, true);
+  t2 = now ();
+  report ("bitmap_count", t1 - t0, t2 - t1);
+
+  /* No match, so both versions have to look at every bit. */
+  bitmap_set_all (b, true);
+  t0 = now ();
+  sink = contains_per_bit (b, 1, bit_cnt - 2, false);
+  t1 = now ();
+  sink = bitmap_contains (b, 1, bit_cnt - 2, false);
+  t2 = now ();
+  report ("bitmap_contains", t1 - t0, t2 - t1);
+
+  bitmap_destroy (b);
+}
+
+/* Bulk bitwise operations.
+
+   Compares bitmap_and(), bitmap_or(), bitmap_xor(),
+   bitmap_andnot() and their _count() variants with loops that
+   combine the bitmaps one bit at a time. */
+
+/* A bulk bitwise operation. */
+enum bitop
+  {
+    BITOP_AND,
+    BITOP_OR,
+    BITOP_XOR,
+    BITOP_ANDNOT,
+    BITOP_CNT
+  };
+
+static const char *const bitop_names[BITOP_CNT] =
+  {"and", "or", "xor", "andnot"};
+
+/* Returns OP applied to bits A and B. */
+static bool
+bitop_bit (enum bitop op, bool a, bool b)
+{
+  switch (op)
+    {
+    case BITOP_AND:
+      return a && b;
+    case BITOP_OR:
+      return a || b;
+    case BITOP_XOR:
+      return a != b;
+    default:
+      return a && !b;
+    }
+}
+
+/* Bit-at-a-time DST = A OP B. */
+static void
+bitop_per_bit (enum bitop op, struct bitmap *dst, const struct bitmap *a,
+               const struct bitmap *b)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (dst); i++)
+    bitmap_set (dst, i, bitop_bit (op, bitmap_test (a, i),
+                                   bitmap_test (b, i)));
+}
+
+/* Bit-at-a-time count of the bits set in A OP B. */
+static size_t
+bitop_count_per_bit (enum bitop op, const struct bitmap *a,
+                     const struct bitmap *b)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < bitmap_size (a); i++)
+    if (bitop_bit (op, bitmap_test (a, i), bitmap_test (b, i)))
+      cnt++;
+  return cnt;
+}
+
+/* DST = A OP B, with the library function for OP. */
+static void
+bitop_word (enum bitop op, struct bitmap *dst, const struct bitmap *a,
+            const struct bitmap *b)
+{
+  switch (op)
+    {
+    case BITOP_AND:
+      bitmap_and (dst, a, b);
+      break;
+    case BITOP_OR:
+      bitmap_or (dst, a, b);
+      break;
+    case BITOP_XOR:
+      bitmap_xor (dst, a, b);
+      break;
+    default:
+      bitmap_andnot (dst, a, b);
+      break;
+    }
+}
+
+/* Returns the number of bits set in A OP B, with the library
+   function for OP. */
+static size_t
+bitop_count_word (enum bitop op, const struct bitmap *a,
+                  const struct bitmap *b)
+{
+  switch (op)
+    {
+    case BITOP_AND:
+      return bitmap_and_count (a, b);
+    case BITOP_OR:
+      return bitmap_or_count (a, b);
+    case BITOP_XOR:
+      return bitmap_xor_count (a, b);
+    default:
+      return bitmap_andnot_count (a, b);
+    }
+}
+
+/* Sets B to runs of true and false bits of random lengths. */
+static void
+fill_random_runs (struct bitmap *b, unsigned *seed)
+{
+  size_t idx = 0;
+  bool value = false;
+
+  while (idx < bitmap_size (b))
+    {
+      size_t cnt = 1 + rand_r (seed) % 64;
+
+      if (cnt > bitmap_size (b) - idx)
+        cnt = bitmap_size (b) - idx;
+      bitmap_set_multiple (b, idx, cnt, value);
+      idx += cnt;
+      value = !value;
+    }
+}
+
+/* Times every bulk operation on bitmaps of BIT_CNT bits. */
+static void
+bench_bitops_size (size_t bit_cnt)
+{
+  struct bitmap *a = bitmap_create (bit_cnt);
+  struct bitmap *b = bitmap_create (bit_cnt);
+  struct bitmap *dst = bitmap_create (bit_cnt);
+  unsigned seed = 1;
+  char what[64];
+  enum bitop op;
+
+  if (a == NULL || b == NULL || dst == NULL)
+    {
+      printf ("  out of memory\n");
+      goto done;
+    }
+  fill_random_runs (a, &seed);
+  fill_random_runs (b, &seed);
+
+  snprintf (what, sizeof what, "%zuM-bit maps", bit_cnt >> 20);
+  printf ("  %-40s %13s %13s\n", what, "per-bit", "word");
+  for (op = 0; op < BITOP_CNT; op++)
+    {
+      double t0, t1, t2;
+
+      t0 = now ();
+      bitop_per_bit (op, dst, a, b);
+      t1 = now ();
+      bitop_word (op, dst, a, b);
+      t2 = now ();
+      snprintf (what, sizeof what, "bitmap_%s", bitop_names[op]);
+      report (what, t1 - t0, t2 - t1);
+
+      t0 = now ();
+      sink = bitop_count_per_bit (op, a, b);
+      t1 = now ();
+      sink = bitop_count_word (op, a, b);
+      t2 = now ();
+      snprintf (what, sizeof what, "bitmap_%s_count", bitop_names[op]);
+      report (what, t1 - t0, t2 - t1);
+    }
+
+ done:
+  bitmap_destroy (a);
+  bitmap_destroy (b);
+  bitmap_destroy (dst);
+}
+
+/* Times the bulk operations on 1M- and 16M-bit maps, and with
+   -l on 256M-bit maps. */
+static void
+bench_bitops (void)
+{
+  bench_bitops_size ((size_t) 1 << 20);
+  bench_bitops_size ((size_t) 1 << 24);
+  if (large)
+    bench_bitops_size ((size_t) 1 << 28);
+}
+
+/* Open addressing against chaining.
+
+   Compares struct ohash with struct hash on int keys: building
+   a table of N keys, and looking up keys that are and are not in
+   it, in random order. */
+
+/* Hash function for int keys. */
+static unsigned
+int_hash (const struct hash_elem *e, void *aux)
+{
+  return hash_int (e->data);
+}
+
+/* Comparison function for int keys. */
+static bool
+int_less (const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+  return a->data < b->data;
+}
+
+/* Equality function for int keys. */
+static bool
+int_equal (const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+  return a->data == b->data;
+}
+
+/* Returns CNT elements holding the keys FIRST through FIRST +
+   CNT - 1, in random order, or a null pointer if memory runs
+   out. */
+static struct hash_elem *
+new_int_elems (int first, size_t cnt, unsigned *seed)
+{
+  struct hash_elem *elems = malloc (cnt * sizeof *elems);
+  size_t i;
+
+  if (elems == NULL)
+    return NULL;
+  for (i = 0; i < cnt; i++)
+    elems[i].data = first + i;
+  for (i = cnt; i > 1; i--)
+    {
+      size_t j = random_index (seed) % i;
+      int tmp = elems[i - 1].data;
+      elems[i - 1].data = elems[j].data;
+      elems[j].data = tmp;
+    }
+  return elems;
+}
+
+/* Times spent on one kind of table. */
+struct table_times
+  {
+    double insert;              /* Building the table. */
+    double hit;                 /* Finding keys in the table. */
+    double miss;                /* Finding keys not in the table. */
+  };
+
+/* Times building a chained table of the CNT elements in ELEMS,
+   ROUNDS times, and ROUNDS lookups of each of the CNT keys in
+   HITS, which are in the table, and in MISSES, which are not. */
+static void
+time_chained (struct hash_elem *elems, struct hash_elem *hits,
+              struct hash_elem *misses, size_t cnt, size_t rounds,
+              struct table_times *t)
+{
+  struct hash h;
+  size_t r, i;
+  double t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    {
+      hash_init (&h, int_hash, int_less, NULL);
+      for (i = 0; i < cnt; i++)
+        hash_insert (&h, &elems[i]);
+      if (r + 1 < rounds)
+        hash_destroy (&h, NULL);
+    }
+  t->insert = now () - t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      sink = (size_t) hash_find (&h, &hits[i]);
+  t->hit = now () - t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      sink = (size_t) hash_find (&h, &misses[i]);
+  t->miss = now () - t0;
+
+  hash_destroy (&h, NULL);
+}
+
+/* Like time_chained(), for an open-addressing table. */
+static void
+time_open (struct hash_elem *elems, struct hash_elem *hits,
+           struct hash_elem *misses, size_t cnt, size_t rounds,
+           struct table_times *t)
+{
+  struct ohash h;
+  size_t r, i;
+  double t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    {
+      ohash_init (&h, int_hash, int_less, NULL);
+      for (i = 0; i < cnt; i++)
+        ohash_insert (&h, &elems[i]);
+      if (r + 1 < rounds)
+        ohash_destroy (&h, NULL);
+    }
+  t->insert = now () - t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      sink = (size_t) ohash_find (&h, &hits[i]);
+  t->hit = now () - t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      sink = (size_t) ohash_find (&h, &misses[i]);
+  t->miss = now () - t0;
+
+  ohash_destroy (&h, NULL);
+}
+
+/* Compares the two kinds of table with CNT keys. */
+static void
+bench_ohash_size (size_t cnt)
+{
+  /* Repeat small cases, to time at least a million operations. */
+  size_t rounds = cnt < 1000000 ? 1000000 / cnt : 1;
+  unsigned seed = 1;
+  struct hash_elem *elems = new_int_elems (0, cnt, &seed);
+  struct hash_elem *hits = new_int_elems (0, cnt, &seed);
+  struct hash_elem *misses = new_int_elems (cnt, cnt, &seed);
+  struct table_times chained, open;
+  char what[64];
+
+  if (elems == NULL || hits == NULL || misses == NULL)
+    {
+      printf ("  out of memory\n");
+      goto done;
+    }
+
+  time_chained (elems, hits, misses, cnt, rounds, &chained);
+  time_open (elems, hits, misses, cnt, rounds, &open);
+
+  snprintf (what, sizeof what, "%zu keys", cnt);
+  printf ("  %-40s %13s %13s\n", what, "chained", "open");
+  report_per_op ("insert", chained.insert, open.insert, rounds * cnt);
+  report_per_op ("find, present", chained.hit, open.hit, rounds * cnt);
+  report_per_op ("find, absent", chained.miss, open.miss, rounds * cnt);
+
+ done:
+  free (elems);
+  free (hits);
+  free (misses);
+}
+
+/* Compares the two kinds of table with 1K, 100K and 1M keys, and
+   with -l 10M keys. */
+static void
+bench_ohash (void)
+{
+  bench_ohash_size (1000);
+  bench_ohash_size (100000);
+  bench_ohash_size (1000000);
+  if (large)
+    bench_ohash_size (10000000);
+}
+
+/* Batched operations.
+
+   Compares hash_insert_batch() and hash_find_batch(), which
+   overlap the cache misses of many operations, with one call of
+   hash_insert() or hash_find() per element, on tables too big
+   for the cache. */
+
+/* Returns an array of pointers to the CNT elements of ELEMS, or
+   a null pointer if memory runs out. */
+static struct hash_elem **
+elem_ptrs (struct hash_elem *elems, size_t cnt)
+{
+  struct hash_elem **ptrs = malloc (cnt * sizeof *ptrs);
+  size_t i;
+
+  if (ptrs != NULL)
+    for (i = 0; i < cnt; i++)
+      ptrs[i] = &elems[i];
+  return ptrs;
+}
+
+/* Compares batched and single operations with CNT keys. */
+static void
+bench_batch_size (size_t cnt)
+{
+  unsigned seed = 1;
+  struct hash_elem *single_elems = new_int_elems (0, cnt, &seed);
+  struct hash_elem *batch_elems = new_int_elems (0, cnt, &seed);
+  struct hash_elem *probes = new_int_elems (0, 2 * cnt, &seed);
+  struct hash_elem **batch_ptrs = NULL, **probe_ptrs = NULL;
+  struct hash_elem **found = malloc (2 * cnt * sizeof *found);
+  struct hash single, batch;
+  double t0, single_insert, batch_insert, single_find, batch_find;
+  char what[64];
+  size_t i;
+
+  if (single_elems == NULL || batch_elems == NULL || probes == NULL
+      || found == NULL
+      || (batch_ptrs = elem_ptrs (batch_elems, cnt)) == NULL
+      || (probe_ptrs = elem_ptrs (probes, 2 * cnt)) == NULL)
+    {
+      printf ("  out of memory\n");
+      goto done;
+    }
+
+  hash_init_equal (&single, int_hash, int_less, int_equal, NULL);
+  hash_init_equal (&batch, int_hash, int_less, int_equal, NULL);
+
+  t0 = now ();
+  for (i = 0; i < cnt; i++)
+    hash_insert (&single, &single_elems[i]);
+  single_insert = now () - t0;
+
+  t0 = now ();
+  hash_insert_batch (&batch, batch_ptrs, cnt, NULL);
+  batch_insert = now () - t0;
+
+  /* Half of the probes are in the tables. */
+  t0 = now ();
+  for (i = 0; i < 2 * cnt; i++)
+    found[i] = hash_find (&single, &probes[i]);
+  single_find = now () - t0;
+
+  t0 = now ();
+  hash_find_batch (&batch, probe_ptrs, 2 * cnt, found);
+  batch_find = now () - t0;
+
+  snprintf (what, sizeof what, "%zu keys", cnt);
+  printf ("  %-40s %13s %13s\n", what, "single", "batch");
+  report_per_op ("insert", single_insert, batch_insert, cnt);
+  report_per_op ("find, half present", single_find, batch_find, 2 * cnt);
+
+  hash_destroy (&single, NULL);
+  hash_destroy (&batch, NULL);
+
+ done:
+  free (single_elems);
+  free (batch_elems);
+  free (probes);
+  free (batch_ptrs);
+  free (probe_ptrs);
+  free (found);
+}
+
+/* Compares batched and single operations with 1M keys, and with
+   -l 10M keys. */
+static void
+bench_batch (void)
+{
+  bench_batch_size (1000000);
+  if (large)
+    bench_batch_size (10000000);
+}
+
+/* Equality callback.
+
+   Compares lookups in a struct hash that tests keys for equality
+   with two calls to its less function against one that has an
+   equality function.  The keys are long strings with a common
+   prefix, and groups of them share a hash value, so every lookup
+   compares the key against a long chain of near matches. */
+
+/* Number of keys that share each hash value. */
+#define STR_CHAIN_LEN 32
+
+/* Hash element with a string key.  `elem.data' is the key's
+   group, which determines its hash value. */
+struct str_elem
+  {
+    struct hash_elem elem;
+    char key[48];
+  };
+
+/* Converts pointer to hash element HASH_ELEM into a pointer to
+   the struct str_elem it is embedded in. */
+#define str_entry(HASH_ELEM)                                    \
+        ((struct str_elem *) ((uint8_t *) (HASH_ELEM)           \
+                              - offsetof (struct str_elem, elem)))
+
+/* Hash function for string keys: colliding on purpose. */
+static unsigned
+str_hash (const struct hash_elem *e, void *aux)
+{
+  return hash_int (e->data);
+}
+
+/* Comparison function for string keys. */
+static bool
+str_less (const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+  return strcmp (str_entry (a)->key, str_entry (b)->key) < 0;
+}
+
+/* Equality function for string keys. */
+static bool
+str_equal (const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+  return !strcmp (str_entry (a)->key, str_entry (b)->key);
+}
+
+/* Returns CNT string elements with keys numbered FIRST through
+   FIRST + CNT - 1, or a null pointer if memory runs out. */
+static struct str_elem *
+new_str_elems (size_t first, size_t cnt)
+{
+  struct str_elem *elems = malloc (cnt * sizeof *elems);
+  size_t i;
+
+  if (elems == NULL)
+    return NULL;
+  for (i = 0; i < cnt; i++)
+    {
+      size_t n = first + i;
+      snprintf (elems[i].key, sizeof elems[i].key,
+                "/usr/share/benchmarks/hash/equality/%010zu", n);
+      elems[i].elem.data = n % (cnt / STR_CHAIN_LEN);
+    }
+  return elems;
+}
+
+/* Builds a table of the CNT elements in ELEMS, using EQUAL if it
+   is non-null, and sets *HIT and *MISS to the time taken by
+   ROUNDS lookups of each of the CNT keys in HITS, which are in
+   the table, and MISSES, which are not. */
+static void
+time_str_finds (hash_equal_func *equal, struct str_elem *elems,
+                struct str_elem *hits, struct str_elem *misses,
+                size_t cnt, size_t rounds, double *hit, double *miss)
+{
+  struct hash h;
+  size_t r, i;
+  double t0;
+
+  hash_init_equal (&h, str_hash, str_less, equal, NULL);
+  for (i = 0; i < cnt; i++)
+    hash_insert (&h, &elems[i].elem);
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      sink = (size_t) hash_find (&h, &hits[i].elem);
+  *hit = now () - t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      sink = (size_t) hash_find (&h, &misses[i].elem);
+  *miss = now () - t0;
+
+  hash_destroy (&h, NULL);
+}
+
+/* Times lookups of 64K string keys in chains of STR_CHAIN_LEN,
+   with and without an equality function. */
+static void
+bench_equal (void)
+{
+  const size_t cnt = 65536, rounds = 4;
+  struct str_elem *elems = new_str_elems (0, cnt);
+  struct str_elem *hits = new_str_elems (0, cnt);
+  struct str_elem *misses = new_str_elems (cnt, cnt);
+  double less_hit, less_miss, equal_hit, equal_miss;
+
+  if (elems == NULL || hits == NULL || misses == NULL)
+    {
+      printf ("  out of memory\n");
+      goto done;
+    }
+
+  time_str_finds (NULL, elems, hits, misses, cnt, rounds,
+                  &less_hit, &less_miss);
+  time_str_finds (str_equal, elems, hits, misses, cnt, rounds,
+                  &equal_hit, &equal_miss);
+
+  printf ("  %-40s %13s %13s\n", "64K keys, 32 per hash value",
+          "less", "equal");
+  report_per_op ("find, present", less_hit, equal_hit, rounds * cnt);
+  report_per_op ("find, absent", less_miss, equal_miss, rounds * cnt);
+
+ done:
+  free (elems);
+  free (hits);
+  free (misses);
+}
+
+/* Hash functions.
+
+   Times the sample hash functions in hash.c, comparing each
+   word-at-a-time function with the byte-at-a-time one it stands
+   in for, and checks how evenly the int hashes spread keys over
+   buckets. */
+
+/* Number of buckets for the distribution check. */
+#define CHI2_BUCKET_CNT 1024
+
+/* Returns the chi-squared statistic of the bucket counts that
+   HASH gives CNT keys, divided by its number of degrees of
+   freedom.  The keys are 0, STRIDE, 2 * STRIDE, ..., or random if
+   STRIDE is 0.  Random input to a good hash gives about 1;
+   regular input may give less.  Much more than 1 means that keys
+   cluster in a few buckets. */
+static double
+chi2_per_df (unsigned (*hash) (int), size_t stride, size_t cnt)
+{
+  static size_t buckets[CHI2_BUCKET_CNT];
+  double expect = (double) cnt / CHI2_BUCKET_CNT, chi2 = 0;
+  unsigned seed = 1;
+  size_t i;
+
+  memset (buckets, 0, sizeof buckets);
+  for (i = 0; i < cnt; i++)
+    {
+      int key = stride != 0 ? (int) (i * stride) : rand_r (&seed);
+      buckets[hash (key) & (CHI2_BUCKET_CNT - 1)]++;
+    }
+  for (i = 0; i < CHI2_BUCKET_CNT; i++)
+    chi2 += (buckets[i] - expect) * (buckets[i] - expect) / expect;
+  return chi2 / (CHI2_BUCKET_CNT - 1);
+}
+
+/* Returns the time to hash the ints 0 through CNT - 1 with HASH. */
+static double
+time_int_hash (unsigned (*hash) (int), size_t cnt)
+{
+  unsigned acc = 0;
+  size_t i;
+  double t0;
+
+  t0 = now ();
+  for (i = 0; i < cnt; i++)
+    acc += hash ((int) i);
+  sink = acc;
+  return now () - t0;
+}
+
+/* Returns the time to hash the SIZE bytes in BUF with HASH,
+   ROUNDS times. */
+static double
+time_bytes_hash (unsigned (*hash) (const void *, size_t),
+                 const void *buf, size_t size, size_t rounds)
+{
+  unsigned acc = 0;
+  size_t r;
+  double t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    acc += hash (buf, size);
+  sink = acc;
+  return now () - t0;
+}
+
+/* Returns the time to hash string S with HASH, ROUNDS times. */
+static double
+time_string_hash (unsigned (*hash) (const char *), const char *s,
+                  size_t rounds)
+{
+  unsigned acc = 0;
+  size_t r;
+  double t0;
+
+  t0 = now ();
+  for (r = 0; r < rounds; r++)
+    acc += hash (s);
+  sink = acc;
+  return now () - t0;
+}
+
+/* Times the hash functions on ints, on byte buffers of several
+   sizes and on strings, and checks the int hashes' spread. */
+static void
+bench_hashfn (void)
+{
+  static const struct
+    {
+      const char *name;
+      unsigned (*hash) (int);
+    }
+  int_hashes[] =
+    {
+      {"hash_int", hash_int},
+      {"hash_int_2", hash_int_2},
+      {"hash_int_mul", hash_int_mul},
+    };
+  static const size_t sizes[] = {8, 64, 1024, 65536};
+  static const size_t lengths[] = {16, 200};
+  const size_t int_cnt = (size_t) 1 << 24, bytes_total = (size_t) 1 << 28;
+  unsigned char *buf = malloc (sizes[3]);
+  char what[64], str[201];
+  size_t i;
+
+  if (buf == NULL)
+    {
+      printf ("  out of memory\n");
+      return;
+    }
+  for (i = 0; i < sizes[3]; i++)
+    buf[i] = i * 131 + 7;
+
+  printf ("  %-40s %13s %13s %13s %13s\n", "16M ints; chi2/df of 1M keys",
+          "time", "0, 1, 2...", "0, 64K...", "random");
+  for (i = 0; i < sizeof int_hashes / sizeof *int_hashes; i++)
+    {
+      unsigned (*hash) (int) = int_hashes[i].hash;
+      const size_t key_cnt = (size_t) 1 << 20;
+      double t = time_int_hash (hash, int_cnt);
+
+      printf ("  %-40s %10.1f ns %13.2f %13.2f %13.2f\n",
+              int_hashes[i].name, t * 1e9 / int_cnt,
+              chi2_per_df (hash, 1, key_cnt),
+              chi2_per_df (hash, 65536, key_cnt),
+              chi2_per_df (hash, 0, key_cnt));
+    }
+
+  printf ("  %-40s %13s %13s\n", "256MB in all, per buffer size",
+          "hash_bytes", "word");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t rounds = bytes_total / sizes[i];
+      double slow = time_bytes_hash (hash_bytes, buf, sizes[i], rounds);
+      double fast = time_bytes_hash (hash_bytes_word, buf, sizes[i], rounds);
+
+      snprintf (what, sizeof what, "%zu bytes", sizes[i]);
+      report (what, slow, fast);
+    }
+
+  printf ("  %-40s %13s %13s\n", "1M strings, per length",
+          "hash_string", "word");
+  for (i = 0; i < sizeof lengths / sizeof *lengths; i++)
+    {
+      const size_t rounds = (size_t) 1 << 20;
+      double slow, fast;
+
+      memset (str, 'a' + i, lengths[i]);
+      str[lengths[i]] = '\0';
+      slow = time_string_hash (hash_string, str, rounds);
+      fast = time_string_hash (hash_string_word, str, rounds);
+      snprintf (what, sizeof what, "%zu characters", lengths[i]);
+      report (what, slow, fast);
+    }
+
+  free (buf);
+}
+
+/* Concurrent lookups.
+
+   Compares struct chash with a struct hash behind one mutex, with
+   1 to 8 threads looking up random keys in the same table at
+   once.  The total number of lookups is the same for every
+   thread count, so with enough CPUs the time should fall as
+   threads are added. */
+
+/* Number of keys in the table. */
+#define SHARED_KEY_CNT 1000000
+
+/* Total number of lookups per case. */
+#define SHARED_FIND_CNT 1000000
+
+/* The tables being looked up in. */
+static struct chash shared_chash;
+static struct hash shared_hash;
+static pthread_mutex_t shared_hash_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A lookup thread. */
+struct finder
+  {
+    pthread_t thread;
+    bool use_chash;             /* Look up in shared_chash? */
+    size_t find_cnt;            /* Number of lookups to do. */
+    unsigned seed;              /* Random state for the keys. */
+  };
+
+/* Thread function for the lookups.  AUX is a struct finder. */
+static void *
+finder_thread (void *aux)
+{
+  struct finder *f = aux;
+  struct hash_elem key;
+  size_t i, found = 0;
+
+  for (i = 0; i < f->find_cnt; i++)
+    {
+      key.data = rand_r (&f->seed) % SHARED_KEY_CNT;
+      if (f->use_chash)
+        found += chash_find (&shared_chash, &key) != NULL;
+      else
+        {
+          pthread_mutex_lock (&shared_hash_lock);
+          found += hash_find (&shared_hash, &key) != NULL;
+          pthread_mutex_unlock (&shared_hash_lock);
+        }
+    }
+  sink = found;
+  return NULL;
+}
+
+/* Returns the time THREAD_CNT threads take to do SHARED_FIND_CNT
+   lookups between them in shared_chash, if USE_CHASH is true, or
+   shared_hash otherwise. */
+static double
+time_shared_finds (bool use_chash, size_t thread_cnt)
+{
+  struct finder finders[8];
+  size_t t;
+  double t0;
+
+  t0 = now ();
+  for (t = 0; t < thread_cnt; t++)
+    {
+      finders[t].use_chash = use_chash;
+      finders[t].find_cnt = SHARED_FIND_CNT / thread_cnt;
+      finders[t].seed = t + 1;
+      if (pthread_create (&finders[t].thread, NULL, finder_thread,
+                          &finders[t]) != 0)
+        {
+          printf ("  pthread_create failed\n");
+          exit (EXIT_FAILURE);
+        }
+    }
+  for (t = 0; t < thread_cnt; t++)
+    pthread_join (finders[t].thread, NULL);
+  return now () - t0;
+}
+
+/* Times lookups in the two kinds of table with 1, 2, 4 and 8
+   threads. */
+static void
+bench_chash (void)
+{
+  unsigned seed = 1;
+  struct hash_elem *chash_elems = new_int_elems (0, SHARED_KEY_CNT, &seed);
+  struct hash_elem *hash_elems = new_int_elems (0, SHARED_KEY_CNT, &seed);
+  size_t thread_cnt, i;
+
+  if (chash_elems == NULL || hash_elems == NULL
+      || !chash_init_equal (&shared_chash, int_hash, int_less, int_equal,
+                            NULL))
+    {
+      printf ("  out of memory\n");
+      free (chash_elems);
+      free (hash_elems);
+      return;
+    }
+  hash_init_equal (&shared_hash, int_hash, int_less, int_equal, NULL);
+  for (i = 0; i < SHARED_KEY_CNT; i++)
+    {
+      chash_insert (&shared_chash, &chash_elems[i]);
+      hash_insert (&shared_hash, &hash_elems[i]);
+    }
+
+  printf ("  %-40s %13s %13s\n", "1M keys, 1M lookups", "mutex", "chash");
+  for (thread_cnt = 1; thread_cnt <= 8; thread_cnt *= 2)
+    {
+      char what[64];
+      double slow = time_shared_finds (false, thread_cnt);
+      double fast = time_shared_finds (true, thread_cnt);
+
+      snprintf (what, sizeof what, "%zu thread%s", thread_cnt,
+                thread_cnt > 1 ? "s" : "");
+      report_per_op (what, slow, fast, SHARED_FIND_CNT);
+    }
+
+  chash_destroy (&shared_chash, NULL);
+  hash_destroy (&shared_hash, NULL);
+  free (chash_elems);
+  free (hash_elems);
+}
+
+/* List sorting.
+
+   Compares list_sort(), which merges runs in place, with
+   list_sort_array(), which sorts an array of element pointers
+   and relinks the list, on 2M elements in random, sorted and
+   reverse order. */
+
+/* Input orders. */
+enum sort_order
+  {
+    ORDER_RANDOM,
+    ORDER_SORTED,
+    ORDER_REVERSE,
+    ORDER_CNT
+  };
+
+static const char *const order_names[ORDER_CNT] =
+  {"random order", "sorted", "reverse order"};
+
+/* Puts the CNT ITEMS into LIST, which must be empty, in array
+   order, with values in ORDER. */
+static void
+fill_list (struct list *list, struct list_item *items, size_t cnt,
+           enum sort_order order)
+{
+  unsigned seed = 1;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      switch (order)
+        {
+        case ORDER_RANDOM:
+          items[i].data = rand_r (&seed);
+          break;
+        case ORDER_SORTED:
+          items[i].data = i;
+          break;
+        default:
+          items[i].data = cnt - i;
+          break;
+        }
+      list_push_back (list, &items[i].elem);
+    }
+}
+
+/* Returns the time SORT takes to sort the CNT ITEMS, in ORDER. */
+static double
+time_sort (void (*sort) (struct list *, list_less_func *, void *),
+           struct list_item *items, size_t cnt, enum sort_order order)
+{
+  struct list list;
+  double t0;
+
+  list_init (&list);
+  fill_list (&list, items, cnt, order);
+  t0 = now ();
+  sort (&list, less, NULL);
+  return now () - t0;
+}
+
+/* Times both sorts on 2M elements in each order. */
+static void
+bench_sort (void)
+{
+  const size_t cnt = (size_t) 1 << 21;
+  struct list_item *items = malloc (cnt * sizeof *items);
+  enum sort_order order;
+
+  if (items == NULL)
+    {
+      printf ("  out of memory\n");
+      return;
+    }
+
+  printf ("  %-40s %13s %13s\n", "2M elements", "in place",
+          "array");
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      double slow = time_sort (list_sort, items, cnt, order);
+      double fast = time_sort (list_sort_array, items, cnt, order);
+
+      report (order_names[order], slow, fast);
+    }
+
+  free (items);
+}
+
+/* Suite table and driver. */
+
+/* A benchmark suite. */
+struct suite
+  {
+    const char *name;           /* Name to select it by. */
+    const char *desc;           /* One-line description. */
+    void (*run) (void);         /* Runs the suite. */
+  };
+
+static const struct suite suites[] =
+  {
+    {"bitmap", "word-at-a-time bitmap range operations", bench_bitmap},
+    {"bitops", "bulk bitwise operations between bitmaps", bench_bitops},
+    {"ohash", "open-addressing and chained hash tables", bench_ohash},
+    {"batch", "batched and single hash table operations", bench_batch},
+    {"equal", "hash lookups with and without an equality function",
+     bench_equal},
+    {"hashfn", "hash function speed and spread", bench_hashfn},
+    {"chash", "concurrent and mutex-locked hash table lookups",
+     bench_chash},
+    {"sort", "list sorting in place and through an array", bench_sort},
+  };
+
+#define SUITE_CNT (sizeof suites / sizeof *suites)
+
+/* Runs suite S. */
+static void
+run_suite (const struct suite *s)
+{
+  printf ("%s: %s\n", s->name, s->desc);
+  s->run ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t i;
+  int arg;
+  bool ran = false;
+
+  for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+    if (!strcmp (argv[arg], "-l"))
+      large = true;
+    else
+      {
+        fprintf (stderr, "usage: bench [-l] [SUITE]...\n");
+        return EXIT_FAILURE;
+      }
+
+  for (; arg < argc; arg++)
+    {
+      for (i = 0; i < SUITE_CNT; i++)
+        if (!strcmp (argv[arg], suites[i].name))
+          break;
+      if (i == SUITE_CNT)
+        {
+          fprintf (stderr, "bench: unknown suite `%s'; suites are:\n",
+                   argv[arg]);
+          for (i = 0; i < SUITE_CNT; i++)
+            fprintf (stderr, "  %-10s %s\n", suites[i].name, suites[i].desc);
+          return EXIT_FAILURE;
+        }
+      run_suite (&suites[i]);
+      ran = true;
+    }
+
+  if (!ran)
+    for (i = 0; i < SUITE_CNT; i++)
+      run_suite (&suites[i]);
+  return EXIT_SUCCESS;
+}
@@ -4,6 +4,15 @@
 #include "round.h"	// 		#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>	
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined (__x86_64__) || defined (__i386__)
+#include <immintrin.h>
+#define BITMAP_X86 1
+#endif
 
 
 #include "hex_dump.h"	
@@ -29,6 +38,48 @@ struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t elem_cap;    /* Number of elements allocated in bits. */
+    struct bitmap_summary *summary;     /* Optional index, or null. */
+    void *map;          /* File mapping, or null if not file-backed. */
+    size_t map_size;    /* Size of the mapping in bytes. */
+    int fd;             /* File descriptor behind the mapping. */
+  };
+
+/* Header at the start of a bitmap file, followed by the bitmap's
+   elements. */
+struct bitmap_file_header
+  {
+    uint32_t magic;     /* Always BITMAP_FILE_MAGIC. */
+    uint32_t version;   /* Always BITMAP_FILE_VERSION. */
+    uint64_t bit_cnt;   /* Number of bits. */
+  };
+
+#define BITMAP_FILE_MAGIC 0x504d5442u   /* "BTMP", little-endian. */
+#define BITMAP_FILE_VERSION 1
+
+/* Maximum number of summary levels.  Each level is ELEM_BITS
+   times smaller than the one below, so this covers any size_t
+   bit count. */
+#define SUMMARY_MAX_LEVELS 11
+
+/* Summary index over the elements of a bitmap.
+
+   Level 0 has one bit per element of the bitmap, which is set
+   when every bit in that element is true.  Each higher level has
+   one bit per element of the level below, set under the same
+   condition, up to a top level that fits in a single element.
+   Unused bits at the end of each level are kept set, so they
+   never look like room.
+
+   With the summary, finding an element that still has a false
+   bit in it touches one element per level rather than walking
+   the bitmap. */
+struct bitmap_summary
+  {
+    size_t level_cnt;                           /* Number of levels. */
+    size_t entry_cnt[SUMMARY_MAX_LEVELS];       /* Bits per level. */
+    elem_type *levels[SUMMARY_MAX_LEVELS];      /* Level storage. */
+    elem_type *words;                           /* All levels' storage. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -70,6 +121,173 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type where the bits numbered FIRST_BIT through
+   LAST_BIT (inclusive) of the element that contains them are
+   turned on.  FIRST_BIT and LAST_BIT must lie in the same
+   element. */
+static inline elem_type
+range_mask (size_t first_bit, size_t last_bit)
+{
+  elem_type lo = (elem_type) -1 << (first_bit % ELEM_BITS);
+  elem_type hi = (elem_type) -1 >> (ELEM_BITS - 1 - last_bit % ELEM_BITS);
+  return lo & hi;
+}
+
+/* Returns the number of bits set to true in E. */
+static inline size_t
+elem_popcount (elem_type e)
+{
+  return __builtin_popcountl (e);
+}
+
+/* Returns the index of the lowest-order bit set to true in E,
+   which must be nonzero. */
+static inline size_t
+elem_ctz (elem_type e)
+{
+  return __builtin_ctzl (e);
+}
+
+/* Recomputes the summary bits of B for elements FIRST through
+   LAST (inclusive) of its bits and propagates the change to the
+   upper levels.  Does nothing if B has no summary.
+
+   Safe to call from many threads at once, so that bitmap_mark()
+   and its kin stay atomic on bitmaps with a summary.  Each
+   summary bit is set or cleared atomically, and then the entry
+   it summarizes is read again; if another thread changed that
+   entry in the meantime, possibly racing with this thread to
+   write the summary bit, the bit is recomputed.  The last thread
+   to write a summary bit therefore always wrote it from the
+   entry's current value. */
+static void
+summary_update (struct bitmap *b, size_t first, size_t last)
+{
+  struct bitmap_summary *s = b->summary;
+  const elem_type *below = b->bits;
+  size_t level, i;
+
+  if (s == NULL)
+    return;
+
+  for (level = 0; level < s->level_cnt; level++)
+    {
+      elem_type *cur = s->levels[level];
+
+      for (i = first; i <= last; i++)
+        {
+          elem_type pad = 0, e, seen;
+
+          if (level == 0 && i == s->entry_cnt[0] - 1)
+            pad = ~last_mask (b);
+          e = __atomic_load_n (&below[i], __ATOMIC_SEQ_CST);
+          do
+            {
+              seen = e;
+              if ((seen | pad) == (elem_type) -1)
+                __atomic_or_fetch (&cur[elem_idx (i)], bit_mask (i),
+                                   __ATOMIC_SEQ_CST);
+              else
+                __atomic_and_fetch (&cur[elem_idx (i)], ~bit_mask (i),
+                                    __ATOMIC_SEQ_CST);
+              e = __atomic_load_n (&below[i], __ATOMIC_SEQ_CST);
+            }
+          while (e != seen);
+        }
+      first = elem_idx (first);
+      last = elem_idx (last);
+      below = cur;
+    }
+}
+
+/* Returns the index of the first element of B's bits at or after
+   element IDX that has at least one false bit, using B's
+   summary, or BITMAP_ERROR if there is none.
+
+   Other threads may update the summary while this runs, so every
+   summary word is read atomically, and an entry that was open on
+   the way up may have filled by the time it is reached on the
+   way down.  In that case the climb resumes just past the
+   element that filled.  The result is only a hint, to be checked
+   against the bits themselves. */
+static size_t
+summary_next_open (const struct bitmap *b, size_t idx)
+{
+  const struct bitmap_summary *s = b->summary;
+  size_t level = 0;
+  elem_type e;
+
+  for (;;)
+    {
+      /* Climb until some level shows a non-full entry at or after
+         IDX. */
+      for (;;)
+        {
+          if (level >= s->level_cnt || idx >= s->entry_cnt[level])
+            return BITMAP_ERROR;
+          e = (~__atomic_load_n (&s->levels[level][elem_idx (idx)],
+                                 __ATOMIC_ACQUIRE)
+               & range_mask (idx, ELEM_BITS - 1));
+          if (e != 0)
+            break;
+          idx = elem_idx (idx) + 1;
+          level++;
+        }
+      idx = elem_idx (idx) * ELEM_BITS + elem_ctz (e);
+
+      /* Descend to level 0, taking the first non-full entry in
+         each element on the way down. */
+      while (level > 0)
+        {
+          e = ~__atomic_load_n (&s->levels[level - 1][idx],
+                                __ATOMIC_ACQUIRE);
+          if (e == 0)
+            break;
+          idx = idx * ELEM_BITS + elem_ctz (e);
+          level--;
+        }
+      if (level == 0)
+        return idx;
+
+      /* Element IDX of level LEVEL - 1 filled up since the climb
+         saw room in it.  Climb again from just past it. */
+      level--;
+      idx = (idx + 1) * ELEM_BITS;
+    }
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none. */
+static size_t
+find_next_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, last;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+
+  /* After XORing with FLIP, a bit is on iff it equals VALUE. */
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  e = (b->bits[idx] ^ flip) & range_mask (start, ELEM_BITS - 1);
+  while (e == 0)
+    {
+      /* When looking for a false bit, the summary can skip over
+         any number of full elements at once. */
+      if (!value && b->summary != NULL)
+        idx = summary_next_open (b, idx + 1);
+      else
+        idx++;
+      if (idx > last)
+        return end;
+      e = b->bits[idx] ^ flip;
+    }
+  start = idx * ELEM_BITS + elem_ctz (e);
+  return start < end ? start : end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -84,6 +302,9 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->elem_cap = elem_cnt (bit_cnt);
+      b->summary = NULL;
+      b->map = NULL;
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
@@ -107,6 +328,9 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size )
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->elem_cap = elem_cnt (bit_cnt);
+  b->summary = NULL;
+  b->map = NULL;
   bitmap_set_all (b, false);
   return b;
 }
@@ -121,17 +345,97 @@ bitmap_buf_size (size_t bit_cnt)
 
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by
-   bitmap_create_preallocated(). */
+   bitmap_create_preallocated().
+   For a file-backed bitmap, unmaps and closes the file.  Changes
+   already made stay in the page cache and reach the file even
+   without bitmap_sync(). */
 void
 bitmap_destroy (struct bitmap *b) 
 {
   if (b != NULL) 
     {
-      free (b->bits);
+      bitmap_drop_summary (b);
+      if (b->map != NULL)
+        {
+          munmap (b->map, b->map_size);
+          close (b->fd);
+        }
+      else
+        free (b->bits);
       free (b);
     }
 }
 
+/* Builds a summary index for B, which speeds up bitmap_scan()
+   and bitmap_scan_and_flip() for false bits on large, mostly
+   full bitmaps.  Once built, the summary is kept up to date by
+   every function that modifies B.  Returns true if successful,
+   false if memory allocation failed. */
+bool
+bitmap_enable_summary (struct bitmap *b)
+{
+  struct bitmap_summary *s;
+  size_t entry_cnt, word_cnt, word_total, level, i;
+
+  ASSERT (b != NULL);
+
+  if (b->summary != NULL)
+    return true;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    return false;
+
+  /* Size each level from the one below it. */
+  s->level_cnt = 0;
+  word_total = 0;
+  for (entry_cnt = elem_cnt (b->bit_cnt); entry_cnt > 0; entry_cnt = word_cnt)
+    {
+      word_cnt = elem_cnt (entry_cnt);
+      s->entry_cnt[s->level_cnt++] = entry_cnt;
+      word_total += word_cnt;
+      if (word_cnt == 1)
+        break;
+    }
+
+  s->words = malloc (sizeof *s->words * word_total);
+  if (s->words == NULL && word_total > 0)
+    {
+      free (s);
+      return false;
+    }
+
+  /* Start out with every entry full, then compute the real
+     entries from B's bits. */
+  word_total = 0;
+  for (level = 0; level < s->level_cnt; level++)
+    {
+      s->levels[level] = s->words + word_total;
+      word_total += elem_cnt (s->entry_cnt[level]);
+    }
+  for (i = 0; i < word_total; i++)
+    s->words[i] = (elem_type) -1;
+
+  b->summary = s;
+  if (s->level_cnt > 0)
+    summary_update (b, 0, s->entry_cnt[0] - 1);
+  return true;
+}
+
+/* Discards B's summary index, if it has one. */
+void
+bitmap_drop_summary (struct bitmap *b)
+{
+  ASSERT (b != NULL);
+
+  if (b->summary != NULL)
+    {
+      free (b->summary->words);
+      free (b->summary);
+      b->summary = NULL;
+    }
+}
+
 /* Bitmap size. */
 
 /* Returns the number of bits in B. */
@@ -163,9 +467,12 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
   elem_type mask = bit_mask (bit_idx);
 
   /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %k1, %k0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+     is guaranteed to be atomic, even on a multiprocessor
+     machine, because of the LOCK prefix.  The operand size
+     follows elem_type, so every bit of the element is reachable.
+     See the description of the OR instruction in [IA32-v2b]. */
+  asm volatile ("lock or %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,9 +483,11 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
   elem_type mask = bit_mask (bit_idx);
 
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %k1, %k0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+     is guaranteed to be atomic, even on a multiprocessor
+     machine.  See the description of the AND instruction in
+     [IA32-v2a]. */
+  asm volatile ("lock and %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
+  summary_update (b, idx, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,9 +500,11 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
   elem_type mask = bit_mask (bit_idx);
 
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %k1, %k0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+     is guaranteed to be atomic, even on a multiprocessor
+     machine.  See the description of the XOR instruction in
+     [IA32-v2b]. */
+  asm volatile ("lock xor %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -216,18 +527,44 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works an element at a time, masking off the partial elements
+   at either end of the range. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t first, last, i;
+  elem_type head, tail;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  head = range_mask (start, ELEM_BITS - 1);
+  tail = range_mask (0, start + cnt - 1);
+  if (first == last)
+    head = tail = head & tail;
+
+  if (value)
+    {
+      b->bits[first] |= head;
+      for (i = first + 1; i < last; i++)
+        b->bits[i] = (elem_type) -1;
+      b->bits[last] |= tail;
+    }
+  else
+    {
+      b->bits[first] &= ~head;
+      for (i = first + 1; i < last; i++)
+        b->bits[i] = 0;
+      b->bits[last] &= ~tail;
+    }
+  summary_update (b, first, last);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -235,17 +572,30 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t first, last, i, true_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (cnt == 0)
+    return 0;
+
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  if (first == last)
+    true_cnt = elem_popcount (b->bits[first]
+                              & range_mask (start, start + cnt - 1));
+  else
+    {
+      true_cnt = elem_popcount (b->bits[first]
+                                & range_mask (start, ELEM_BITS - 1));
+      for (i = first + 1; i < last; i++)
+        true_cnt += elem_popcount (b->bits[i]);
+      true_cnt += elem_popcount (b->bits[last]
+                                 & range_mask (0, start + cnt - 1));
+    }
+  return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -253,16 +603,29 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t first, last, i;
+  elem_type flip = value ? 0 : (elem_type) -1;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
+  if (cnt == 0)
+    return false;
+
+  /* After XORing with FLIP, a bit is on iff it equals VALUE. */
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  if (first == last)
+    return ((b->bits[first] ^ flip)
+            & range_mask (start, start + cnt - 1)) != 0;
+
+  if ((b->bits[first] ^ flip) & range_mask (start, ELEM_BITS - 1))
+    return true;
+  for (i = first + 1; i < last; i++)
+    if (b->bits[i] ^ flip)
       return true;
-  return false;
+  return ((b->bits[last] ^ flip) & range_mask (0, start + cnt - 1)) != 0;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -289,12 +652,298 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
   return !bitmap_contains (b, start, cnt, false);
 }
 
+/* Bitwise operations between bitmaps. */
+
+/* Operation applied element by element by combine(). */
+enum combine_op
+  {
+    COMBINE_AND,        /* A & B. */
+    COMBINE_OR,         /* A | B. */
+    COMBINE_XOR,        /* A ^ B. */
+    COMBINE_ANDNOT      /* A & ~B. */
+  };
+
+/* Returns OP applied to A and B. */
+static inline elem_type
+combine_elem (enum combine_op op, elem_type a, elem_type b)
+{
+  switch (op)
+    {
+    case COMBINE_AND:
+      return a & b;
+    case COMBINE_OR:
+      return a | b;
+    case COMBINE_XOR:
+      return a ^ b;
+    default:
+      return a & ~b;
+    }
+}
+
+/* Stores OP applied to the first N elements of A and B into the
+   first N elements of DST, which may be the same as A or B.
+   Portable version. */
+static void
+combine_scalar (elem_type *dst, const elem_type *a, const elem_type *b,
+                size_t n, enum combine_op op)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = combine_elem (op, a[i], b[i]);
+}
+
+/* Returns the number of true bits in OP applied to the first N
+   elements of A and B.  Portable version. */
+static size_t
+combine_count_scalar (const elem_type *a, const elem_type *b, size_t n,
+                      enum combine_op op)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < n; i++)
+    cnt += elem_popcount (combine_elem (op, a[i], b[i]));
+  return cnt;
+}
+
+#ifdef BITMAP_X86
+/* SSE2 version of combine_scalar(). */
+__attribute__ ((target ("sse2")))
+static void
+combine_sse2 (elem_type *dst, const elem_type *a, const elem_type *b,
+              size_t n, enum combine_op op)
+{
+  const size_t per_vec = sizeof (__m128i) / sizeof (elem_type);
+  size_t i;
+
+  for (i = 0; i + per_vec <= n; i += per_vec)
+    {
+      __m128i x = _mm_loadu_si128 ((const __m128i *) (a + i));
+      __m128i y = _mm_loadu_si128 ((const __m128i *) (b + i));
+      switch (op)
+        {
+        case COMBINE_AND:
+          x = _mm_and_si128 (x, y);
+          break;
+        case COMBINE_OR:
+          x = _mm_or_si128 (x, y);
+          break;
+        case COMBINE_XOR:
+          x = _mm_xor_si128 (x, y);
+          break;
+        default:
+          x = _mm_andnot_si128 (y, x);
+          break;
+        }
+      _mm_storeu_si128 ((__m128i *) (dst + i), x);
+    }
+  combine_scalar (dst + i, a + i, b + i, n - i, op);
+}
+
+/* AVX2 version of combine_scalar(). */
+__attribute__ ((target ("avx2")))
+static void
+combine_avx2 (elem_type *dst, const elem_type *a, const elem_type *b,
+              size_t n, enum combine_op op)
+{
+  const size_t per_vec = sizeof (__m256i) / sizeof (elem_type);
+  size_t i;
+
+  for (i = 0; i + per_vec <= n; i += per_vec)
+    {
+      __m256i x = _mm256_loadu_si256 ((const __m256i *) (a + i));
+      __m256i y = _mm256_loadu_si256 ((const __m256i *) (b + i));
+      switch (op)
+        {
+        case COMBINE_AND:
+          x = _mm256_and_si256 (x, y);
+          break;
+        case COMBINE_OR:
+          x = _mm256_or_si256 (x, y);
+          break;
+        case COMBINE_XOR:
+          x = _mm256_xor_si256 (x, y);
+          break;
+        default:
+          x = _mm256_andnot_si256 (y, x);
+          break;
+        }
+      _mm256_storeu_si256 ((__m256i *) (dst + i), x);
+    }
+  combine_scalar (dst + i, a + i, b + i, n - i, op);
+}
+
+/* Version of combine_count_scalar() that uses the POPCNT
+   instruction, which beats any vector bit-counting trick that
+   SSE2 or AVX2 alone can offer for this loop. */
+__attribute__ ((target ("popcnt")))
+static size_t
+combine_count_popcnt (const elem_type *a, const elem_type *b, size_t n,
+                      enum combine_op op)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < n; i++)
+    cnt += __builtin_popcountl (combine_elem (op, a[i], b[i]));
+  return cnt;
+}
+#endif /* BITMAP_X86 */
+
+/* Returns the best version of combine_scalar() for this CPU. */
+static void
+(*select_combine (void)) (elem_type *, const elem_type *,
+                          const elem_type *, size_t, enum combine_op)
+{
+#ifdef BITMAP_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    return combine_avx2;
+  if (__builtin_cpu_supports ("sse2"))
+    return combine_sse2;
+#endif
+  return combine_scalar;
+}
+
+/* Returns the best version of combine_count_scalar() for this
+   CPU. */
+static size_t
+(*select_combine_count (void)) (const elem_type *, const elem_type *,
+                                size_t, enum combine_op)
+{
+#ifdef BITMAP_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("popcnt"))
+    return combine_count_popcnt;
+#endif
+  return combine_count_scalar;
+}
+
+/* Stores OP applied to A and B into DST.  All three bitmaps must
+   have the same size; DST may be A or B. */
+static void
+combine (struct bitmap *dst, const struct bitmap *a, const struct bitmap *b,
+         enum combine_op op)
+{
+  static void (*kernel) (elem_type *, const elem_type *, const elem_type *,
+                         size_t, enum combine_op);
+  size_t n;
+
+  ASSERT (dst != NULL && a != NULL && b != NULL);
+  ASSERT (a->bit_cnt == dst->bit_cnt && b->bit_cnt == dst->bit_cnt);
+
+  if (kernel == NULL)
+    kernel = select_combine ();
+
+  n = elem_cnt (dst->bit_cnt);
+  if (n == 0)
+    return;
+  kernel (dst->bits, a->bits, b->bits, n, op);
+  summary_update (dst, 0, n - 1);
+}
+
+/* Returns the number of true bits in OP applied to A and B,
+   which must have the same size. */
+static size_t
+combine_count (const struct bitmap *a, const struct bitmap *b,
+               enum combine_op op)
+{
+  static size_t (*kernel) (const elem_type *, const elem_type *, size_t,
+                           enum combine_op);
+  size_t n;
+
+  ASSERT (a != NULL && b != NULL);
+  ASSERT (a->bit_cnt == b->bit_cnt);
+
+  if (kernel == NULL)
+    kernel = select_combine_count ();
+
+  /* Bits past the end of the last element are unused and may hold
+     anything, so mask them off. */
+  n = elem_cnt (a->bit_cnt);
+  if (n == 0)
+    return 0;
+  return (kernel (a->bits, b->bits, n - 1, op)
+          + elem_popcount (combine_elem (op, a->bits[n - 1], b->bits[n - 1])
+                           & last_mask (a)));
+}
+
+/* Sets DST to the bitwise AND of A and B.  All three bitmaps must
+   have the same size; DST may be A or B, for an in-place
+   operation. */
+void
+bitmap_and (struct bitmap *dst, const struct bitmap *a, const struct bitmap *b)
+{
+  combine (dst, a, b, COMBINE_AND);
+}
+
+/* Sets DST to the bitwise OR of A and B.  All three bitmaps must
+   have the same size; DST may be A or B. */
+void
+bitmap_or (struct bitmap *dst, const struct bitmap *a, const struct bitmap *b)
+{
+  combine (dst, a, b, COMBINE_OR);
+}
+
+/* Sets DST to the bitwise XOR of A and B.  All three bitmaps must
+   have the same size; DST may be A or B. */
+void
+bitmap_xor (struct bitmap *dst, const struct bitmap *a, const struct bitmap *b)
+{
+  combine (dst, a, b, COMBINE_XOR);
+}
+
+/* Sets DST to the bits of A that are not set in B.  All three
+   bitmaps must have the same size; DST may be A or B. */
+void
+bitmap_andnot (struct bitmap *dst, const struct bitmap *a,
+               const struct bitmap *b)
+{
+  combine (dst, a, b, COMBINE_ANDNOT);
+}
+
+/* Returns the number of bits set in both A and B, which must
+   have the same size, without building the result. */
+size_t
+bitmap_and_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return combine_count (a, b, COMBINE_AND);
+}
+
+/* Returns the number of bits set in A or B, which must have the
+   same size. */
+size_t
+bitmap_or_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return combine_count (a, b, COMBINE_OR);
+}
+
+/* Returns the number of bits set in exactly one of A and B,
+   which must have the same size. */
+size_t
+bitmap_xor_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return combine_count (a, b, COMBINE_XOR);
+}
+
+/* Returns the number of bits set in A but not in B, which must
+   have the same size. */
+size_t
+bitmap_andnot_count (const struct bitmap *a, const struct bitmap *b)
+{
+  return combine_count (a, b, COMBINE_ANDNOT);
+}
+
 /* Finding set or unset bits. */
 
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Rather than testing every candidate index, alternately jumps
+   to the next bit equal to VALUE and then to the next bit that
+   breaks the run, so each element is examined only a few
+   times. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
@@ -304,10 +953,22 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      if (cnt == 0)
+        return i;
+      while (i <= last)
+        {
+          size_t run_end;
+
+          i = find_next_bit (b, i, last + 1, value);
+          if (i > last)
+            break;
+          run_end = find_next_bit (b, i, i + cnt, !value);
+          if (run_end == i + cnt)
+            return i;
+          i = run_end + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -318,7 +979,9 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
    If there is no such group, returns BITMAP_ERROR.
    If CNT is zero, returns 0.
    Bits are set atomically, but testing bits is not atomic with
-   setting them. */
+   setting them.
+   If B has a summary index, it is updated along with the
+   bits. */
 size_t
 bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
 {
@@ -328,11 +991,312 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
-/* Returns the number of bytes needed to store B in a file. */
+/* Returns the bits of element ELEM_IDX that fall within the CNT
+   bits starting at START, which must be nonempty and overlap
+   that element. */
+static inline elem_type
+run_mask (size_t start, size_t cnt, size_t elem_idx_)
+{
+  size_t first = elem_idx (start) == elem_idx_ ? start : elem_idx_ * ELEM_BITS;
+  size_t last = elem_idx (start + cnt - 1) == elem_idx_
+                ? start + cnt - 1 : elem_idx_ * ELEM_BITS + ELEM_BITS - 1;
+  return range_mask (first, last);
+}
+
+/* Atomically flips the bits in MASK of element IDX of B, but
+   only if all of them are still set to VALUE.  Returns true if
+   successful, false if some other thread got to one of them
+   first. */
+static bool
+claim_bits (struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  elem_type old = __atomic_load_n (&b->bits[idx], __ATOMIC_RELAXED);
+
+  do
+    {
+      if ((value ? ~old : old) & mask)
+        return false;
+    }
+  while (!__atomic_compare_exchange_n (&b->bits[idx], &old, old ^ mask,
+                                       false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_RELAXED));
+  return true;
+}
+
+/* Like bitmap_scan_and_flip(), but safe to call from many
+   threads at once on the same bitmap, alongside bitmap_mark(),
+   bitmap_reset() and bitmap_flip().  No two callers ever get
+   overlapping groups.
+
+   Each element of a candidate group is claimed with a
+   compare-and-swap, in ascending order.  If another thread
+   changes one of the bits first, the elements claimed so far are
+   given back and the scan resumes at the same place, so no lock
+   is ever held.  If B has a summary index, it is updated along
+   with the bits. */
+size_t
+bitmap_scan_and_flip_atomic (struct bitmap *b, size_t start, size_t cnt,
+                             bool value)
+{
+  ASSERT (b != NULL);
+
+  if (cnt == 0)
+    return bitmap_scan (b, start, cnt, value);
+
+  for (;;)
+    {
+      size_t idx = bitmap_scan (b, start, cnt, value);
+      size_t first, last, i;
+
+      if (idx == BITMAP_ERROR)
+        return BITMAP_ERROR;
+
+      first = elem_idx (idx);
+      last = elem_idx (idx + cnt - 1);
+      for (i = first; i <= last; i++)
+        if (!claim_bits (b, i, run_mask (idx, cnt, i), value))
+          break;
+      if (i > last)
+        {
+          summary_update (b, first, last);
+          return idx;
+        }
+
+      /* Lost a race.  The bits claimed so far are ours alone, so
+         flipping them back restores them exactly. */
+      last = i;
+      while (i-- > first)
+        __atomic_xor_fetch (&b->bits[i], run_mask (idx, cnt, i),
+                            __ATOMIC_RELEASE);
+      if (last > first)
+        summary_update (b, first, last - 1);
+      start = idx;
+    }
+}
+
+/* Iterating over set bits. */
+
+/* Returns the index of the first bit in B at or after FROM that
+   is set to true, or BITMAP_ERROR if there is none.
+
+   Iteration idiom:
+
+      size_t i;
+
+      for (i = bitmap_next_set (b, 0); i != BITMAP_ERROR;
+           i = bitmap_next_set (b, i + 1))
+        {
+          ...do something with bit i...
+        }
+
+   Each call skips whole elements of false bits at once, so a
+   walk over a sparse bitmap costs time proportional to the number
+   of elements plus the number of set bits. */
+size_t
+bitmap_next_set (const struct bitmap *b, size_t from)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  if (from >= b->bit_cnt)
+    return BITMAP_ERROR;
+  idx = find_next_bit (b, from, b->bit_cnt, true);
+  return idx < b->bit_cnt ? idx : BITMAP_ERROR;
+}
+
+/* Calls ACTION for the index of each bit in B that is set to
+   true, in increasing order, given auxiliary data AUX.
+   Modifying B from ACTION yields undefined behavior. */
+void
+bitmap_foreach_set (const struct bitmap *b, bitmap_action_func *action,
+                    void *aux)
+{
+  size_t n, i;
+
+  ASSERT (b != NULL);
+  ASSERT (action != NULL);
+
+  n = elem_cnt (b->bit_cnt);
+  for (i = 0; i < n; i++)
+    {
+      elem_type e = b->bits[i];
+
+      if (i == n - 1)
+        e &= last_mask (b);
+      while (e != 0)
+        {
+          action (i * ELEM_BITS + elem_ctz (e), aux);
+          e &= e - 1;
+        }
+    }
+}
+
+/* Returns the number of bytes needed to store B in a file,
+   including the header written by bitmap_create_file(). */
 size_t
 bitmap_file_size (const struct bitmap *b) 
 {
-  return byte_cnt (b->bit_cnt);
+  return sizeof (struct bitmap_file_header) + byte_cnt (b->bit_cnt);
+}
+
+/* Maps the first SIZE bytes of FD into memory and attaches them
+   to B, whose bit_cnt must already be set.  Returns true if
+   successful, false on failure. */
+static bool
+map_file (struct bitmap *b, int fd, size_t size)
+{
+  void *map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+
+  b->map = map;
+  b->map_size = size;
+  b->fd = fd;
+  b->bits = (elem_type *) ((struct bitmap_file_header *) map + 1);
+  b->elem_cap = elem_cnt (b->bit_cnt);
+  b->summary = NULL;
+  return true;
+}
+
+/* Creates the file named PATH, replacing any existing file, to
+   hold a bitmap of BIT_CNT bits, all set to false, and returns
+   the bitmap mapped from it.  Changes to the bitmap go straight
+   to the page cache; call bitmap_sync() to force them to disk.
+   Returns a null pointer on failure. */
+struct bitmap *
+bitmap_create_file (const char *path, size_t bit_cnt)
+{
+  struct bitmap *b;
+  struct bitmap_file_header *h;
+  size_t size = sizeof *h + byte_cnt (bit_cnt);
+  int fd;
+
+  ASSERT (path != NULL);
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return NULL;
+
+  fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      free (b);
+      return NULL;
+    }
+
+  /* A freshly extended file reads as zeros, so every bit starts
+     out false. */
+  b->bit_cnt = bit_cnt;
+  if (ftruncate (fd, size) < 0 || !map_file (b, fd, size))
+    {
+      close (fd);
+      free (b);
+      return NULL;
+    }
+
+  h = b->map;
+  h->magic = BITMAP_FILE_MAGIC;
+  h->version = BITMAP_FILE_VERSION;
+  h->bit_cnt = bit_cnt;
+  return b;
+}
+
+/* Returns true if BIT_CNT, read from a bitmap file's header, is
+   a bit count that a mapping of the whole file can hold.  A
+   corrupt header may claim any count, and for counts near the
+   top of the range, byte_cnt() and the file size computed from
+   it wrap around to small numbers that a short file would
+   satisfy. */
+static bool
+file_bit_cnt_ok (uint64_t bit_cnt)
+{
+  return (bit_cnt <= SIZE_MAX - (ELEM_BITS - 1)
+          && (byte_cnt (bit_cnt)
+              <= SIZE_MAX - sizeof (struct bitmap_file_header)));
+}
+
+/* Opens the bitmap stored in the file named PATH by
+   bitmap_create_file() and returns it, mapped straight from the
+   file without reading it.  Returns a null pointer if the file
+   can't be opened or isn't a valid bitmap file. */
+struct bitmap *
+bitmap_open_file (const char *path)
+{
+  struct bitmap *b;
+  struct bitmap_file_header h;
+  struct stat st;
+  int fd;
+
+  ASSERT (path != NULL);
+
+  fd = open (path, O_RDWR);
+  if (fd < 0)
+    return NULL;
+
+  if (pread (fd, &h, sizeof h, 0) != sizeof h
+      || h.magic != BITMAP_FILE_MAGIC
+      || h.version != BITMAP_FILE_VERSION
+      || !file_bit_cnt_ok (h.bit_cnt)
+      || fstat (fd, &st) < 0
+      || (uint64_t) st.st_size < sizeof h + byte_cnt (h.bit_cnt)
+      || (b = malloc (sizeof *b)) == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  b->bit_cnt = h.bit_cnt;
+  if (!map_file (b, fd, sizeof h + byte_cnt (h.bit_cnt)))
+    {
+      close (fd);
+      free (b);
+      return NULL;
+    }
+  return b;
+}
+
+/* Writes the changes made to file-backed bitmap B back to its
+   file and waits for them to reach the disk.  Returns true if
+   successful, false on failure.  Does nothing and returns true
+   for a bitmap that isn't file-backed. */
+bool
+bitmap_sync (struct bitmap *b)
+{
+  ASSERT (b != NULL);
+
+  if (b->map == NULL)
+    return true;
+  return msync (b->map, b->map_size, MS_SYNC) == 0;
+}
+
+/* Grows file-backed bitmap B to NEW_CNT bits by extending its
+   file and mapping it again.  The new bits read as zeros, but
+   bits past the old end in its last element may not, so the
+   caller must still clear them.  Returns true if successful,
+   false on failure, in which case B is unchanged. */
+static bool
+expand_file (struct bitmap *b, size_t new_cnt)
+{
+  struct bitmap_file_header *h;
+  size_t size = sizeof *h + byte_cnt (new_cnt);
+  void *map;
+
+  if (ftruncate (b->fd, size) < 0)
+    return false;
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+
+  munmap (b->map, b->map_size);
+  b->map = map;
+  b->map_size = size;
+  b->bits = (elem_type *) ((struct bitmap_file_header *) map + 1);
+  b->elem_cap = elem_cnt (new_cnt);
+
+  h = map;
+  h->bit_cnt = new_cnt;
+  return true;
 }
 
 /* Debugging. */
@@ -344,6 +1308,84 @@ bitmap_dump (const struct bitmap *b)
   hex_dump (0, b->bits, byte_cnt (b->bit_cnt)/2, false);
 }
 
+/* Like bitmap_dump(), but writes to file descriptor FD. */
+void
+bitmap_dump_fd (const struct bitmap *b, int fd)
+{
+  hex_dump_fd (fd, 0, b->bits, byte_cnt (b->bit_cnt)/2, false);
+}
+
+/* Number of characters write_bits() formats before writing them
+   out.  Must be a multiple of ELEM_BITS. */
+#define BITS_BUF_SIZE 32768
+
+/* The eight '0' and '1' characters for each byte value, lowest
+   order bit first, matching the order of bits in a bitmap. */
+static char byte_chars[256][8];
+
+/* Fills in byte_chars, if that hasn't been done yet. */
+static void
+init_byte_chars (void)
+{
+  static bool done;
+  int byte, bit;
+
+  if (done)
+    return;
+  for (byte = 0; byte < 256; byte++)
+    for (bit = 0; bit < 8; bit++)
+      byte_chars[byte][bit] = (byte >> bit) & 1 ? '1' : '0';
+  done = true;
+}
+
+/* Writes the bits of B as a line of '0' and '1' characters to
+   FILE, if it is non-null, or to file descriptor FD otherwise.
+   Each byte of B is expanded through byte_chars, and the output
+   is written BITS_BUF_SIZE characters at a time. */
+static void
+write_bits (const struct bitmap *b, FILE *file, int fd)
+{
+  char buf[BITS_BUF_SIZE + 1];
+  size_t n = elem_cnt (b->bit_cnt);
+  size_t len = 0, i, j;
+
+  init_byte_chars ();
+  for (i = 0; i < n; i++)
+    {
+      elem_type e = b->bits[i];
+
+      for (j = 0; j < sizeof e; j++)
+        {
+          memcpy (buf + len, byte_chars[(e >> (j * CHAR_BIT)) & 0xff], 8);
+          len += 8;
+        }
+
+      if (i == n - 1)
+        {
+          /* Drop the unused bits of the last element and end the
+             line. */
+          len -= n * ELEM_BITS - b->bit_cnt;
+          buf[len++] = '\n';
+        }
+      if (len + ELEM_BITS > BITS_BUF_SIZE || i == n - 1)
+        {
+          hex_dump_write (file, fd, buf, len);
+          len = 0;
+        }
+    }
+}
+
+/* Writes the bits of B to file descriptor FD as a line of '0'
+   and '1' characters, the same format as dumpdata_bitmap(). */
+void
+bitmap_write_bits (const struct bitmap *b, int fd)
+{
+  ASSERT (b != NULL);
+
+  if (b->bit_cnt > 0)
+    write_bits (b, NULL, fd);
+}
+
 
 void
 dumpdata_bitmap (struct bitmap **Bitmap, char *bitmap_name)
@@ -352,30 +1394,80 @@ dumpdata_bitmap (struct bitmap **Bitmap, char *bitmap_name)
 
   ASSERT (Bitmap[index] != NULL);
 
-  if(bitmap_size(Bitmap[index]) == 0)
+  if (bitmap_size (Bitmap[index]) == 0)
     return;
 
-  for (size_t i = 0; i < bitmap_size(Bitmap[index]); i++)
-      printf ("%d", bitmap_test (Bitmap[index], i) ? 1 : 0);
-
-  printf ("\n");
+  write_bits (Bitmap[index], stdout, -1);
 
   return;
 }
 
+/* Grows BITMAP by SIZE bits, all set to false, and returns it.
+
+   BITMAP keeps spare capacity and grows it geometrically with
+   realloc(), so a long series of small expansions costs amortized
+   O(1) per added element, and the existing bits are never copied
+   one at a time.  The returned pointer is BITMAP itself, except
+   for a bitmap created by bitmap_create_in_buf(): its storage
+   can't be resized, so it is copied into a new bitmap from
+   bitmap_create() and the copy is returned, leaving the caller's
+   buffer alone.  A file-backed bitmap grows its file instead.
+   Returns a null pointer if memory allocation
+   fails, in which case BITMAP is unchanged. */
 struct bitmap *
 bitmap_expand (struct bitmap *bitmap, size_t size)
 {
-  if (bitmap != NULL && size >= 0)
+  size_t old_cnt, new_cnt, need;
+  bool had_summary;
+
+  if (bitmap == NULL)
+    return NULL;
+
+  old_cnt = bitmap->bit_cnt;
+  new_cnt = old_cnt + size;
+  need = elem_cnt (new_cnt);
+
+  if (bitmap->bits == (elem_type *) (bitmap + 1))
     {
-      struct bitmap *res = bitmap_create (bitmap_size (bitmap) + size);
+      struct bitmap *res = bitmap_create (new_cnt);
 
-      for (size_t i = 0; i < bitmap_size (bitmap); i++)
-        if (bitmap_test (bitmap, i))
-          bitmap_mark(res, i);
-      
+      if (res == NULL)
+        return NULL;
+      memcpy (res->bits, bitmap->bits, byte_cnt (old_cnt));
+      bitmap_set_multiple (res, old_cnt, size, false);
+      if (bitmap->summary != NULL)
+        bitmap_enable_summary (res);
       return res;
     }
-  
-  return NULL;
-}
\ No newline at end of file
+
+  if (bitmap->map != NULL)
+    {
+      if (need > bitmap->elem_cap && !expand_file (bitmap, new_cnt))
+        return NULL;
+      ((struct bitmap_file_header *) bitmap->map)->bit_cnt = new_cnt;
+    }
+  else if (need > bitmap->elem_cap)
+    {
+      size_t cap = bitmap->elem_cap * 2;
+      elem_type *bits;
+
+      if (cap < need)
+        cap = need;
+      bits = realloc (bitmap->bits, sizeof *bits * cap);
+      if (bits == NULL)
+        return NULL;
+      bitmap->bits = bits;
+      bitmap->elem_cap = cap;
+    }
+
+  /* The summary's shape depends on the bit count, so rebuild it
+     rather than patching it. */
+  had_summary = bitmap->summary != NULL;
+  bitmap_drop_summary (bitmap);
+  bitmap->bit_cnt = new_cnt;
+  bitmap_set_multiple (bitmap, old_cnt, size, false);
+  if (had_summary)
+    bitmap_enable_summary (bitmap);
+
+  return bitmap;
+}
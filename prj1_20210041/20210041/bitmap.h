@@ -32,17 +32,50 @@ bool bitmap_any (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_none (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 
+/* Bitwise operations between bitmaps of the same size. */
+void bitmap_and (struct bitmap *dst, const struct bitmap *,
+                 const struct bitmap *);
+void bitmap_or (struct bitmap *dst, const struct bitmap *,
+                const struct bitmap *);
+void bitmap_xor (struct bitmap *dst, const struct bitmap *,
+                 const struct bitmap *);
+void bitmap_andnot (struct bitmap *dst, const struct bitmap *,
+                    const struct bitmap *);
+size_t bitmap_and_count (const struct bitmap *, const struct bitmap *);
+size_t bitmap_or_count (const struct bitmap *, const struct bitmap *);
+size_t bitmap_xor_count (const struct bitmap *, const struct bitmap *);
+size_t bitmap_andnot_count (const struct bitmap *, const struct bitmap *);
+
 /* Finding set or unset bits. */
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_and_flip_atomic (struct bitmap *, size_t start, size_t cnt,
+                                    bool);
+
+/* Iterating over set bits. */
+typedef void bitmap_action_func (size_t idx, void *aux);
+size_t bitmap_next_set (const struct bitmap *, size_t from);
+void bitmap_foreach_set (const struct bitmap *, bitmap_action_func *,
+                         void *aux);
+
+/* Summary index for fast scans of mostly full bitmaps. */
+bool bitmap_enable_summary (struct bitmap *);
+void bitmap_drop_summary (struct bitmap *);
 
 /* File input and output. */
 size_t bitmap_file_size (const struct bitmap *);
+struct bitmap *bitmap_create_file (const char *path, size_t bit_cnt);
+struct bitmap *bitmap_open_file (const char *path);
+bool bitmap_sync (struct bitmap *);
 
 /* Debugging. */
 void bitmap_dump (const struct bitmap *);
+void bitmap_dump_fd (const struct bitmap *, int fd);
+void bitmap_write_bits (const struct bitmap *, int fd);
 
+/* Number of bitmap slots in main(), bm0 through bm19. */
+#define BITMAP_SLOT_CNT 20
 
 void dumpdata_bitmap (struct bitmap **, char *);
 
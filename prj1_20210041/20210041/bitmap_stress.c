@@ -0,0 +1,331 @@
+/* Multithreaded stress test for the atomic bitmap operations.
+
+   Runs bitmap_mark(), bitmap_reset(), bitmap_flip() and
+   bitmap_scan_and_flip_atomic() from THREAD_CNT threads at once
+   on shared bitmaps, with and without a summary index, and then
+   checks that no update was lost, that no bit was handed out
+   twice, and that the summary still agrees with the bits.
+   Prints PASS and exits with status 0 if every check passes.
+
+   The races these tests look for need threads running at the
+   same time on different CPUs.  On a machine with one CPU the
+   threads only interleave at preemption points, so a PASS there
+   says little; the program prints a note when that is the
+   case. */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bitmap.h"
+
+/* Number of threads per test. */
+#define THREAD_CNT 8
+
+/* Number of bits in each test bitmap.  Not a multiple of the
+   element size, so the partial last element gets exercised. */
+#define BIT_CNT 100003
+
+/* Number of single-bit operations per thread. */
+#define OP_CNT 400000
+
+/* Shared state of one test. */
+static struct bitmap *bitmap;
+static bool failed;
+
+/* Records a failed check. */
+static void
+fail (const char *what, size_t idx)
+{
+  printf ("FAIL: %s at bit %zu\n", what, idx);
+  failed = true;
+}
+
+/* Single-bit operations.
+
+   Thread T owns the bits whose index is T modulo THREAD_CNT, so
+   every element of the bitmap is updated by every thread, and
+   keeps its own copy of what each of its bits should be. */
+
+/* Thread function for the single-bit test.  AUX is the thread
+   number. */
+static void *
+single_bit_thread (void *aux)
+{
+  size_t t = (size_t) aux;
+  unsigned seed = t + 1;
+  size_t own_cnt = (BIT_CNT - t + THREAD_CNT - 1) / THREAD_CNT;
+  bool *expect = calloc (own_cnt, sizeof *expect);
+  size_t i;
+
+  if (expect == NULL)
+    {
+      fail ("out of memory", 0);
+      return NULL;
+    }
+
+  for (i = 0; i < OP_CNT; i++)
+    {
+      size_t k = rand_r (&seed) % own_cnt;
+      size_t idx = k * THREAD_CNT + t;
+
+      switch (rand_r (&seed) % 3)
+        {
+        case 0:
+          bitmap_mark (bitmap, idx);
+          expect[k] = true;
+          break;
+        case 1:
+          bitmap_reset (bitmap, idx);
+          expect[k] = false;
+          break;
+        default:
+          bitmap_flip (bitmap, idx);
+          expect[k] = !expect[k];
+          break;
+        }
+    }
+
+  /* Leave most bits set, so that the summary has full elements
+     to skip over in the final check. */
+  for (i = 0; i < own_cnt; i++)
+    if (rand_r (&seed) % 64 != 0)
+      {
+        bitmap_mark (bitmap, i * THREAD_CNT + t);
+        expect[i] = true;
+      }
+
+  for (i = 0; i < own_cnt; i++)
+    if (bitmap_test (bitmap, i * THREAD_CNT + t) != expect[i])
+      fail ("lost single-bit update", i * THREAD_CNT + t);
+  free (expect);
+  return NULL;
+}
+
+/* Group allocation.
+
+   Every thread claims groups of false bits until none are left,
+   giving a few single bits back along the way, and records which
+   bits it holds at the end. */
+
+/* Bits held by each thread, as 1 + thread number, or 0, or
+   NEVER_FREE for the bits that stay set in the claiming test. */
+static unsigned char owner[BIT_CNT];
+
+/* Thread function for the group allocation test.  AUX is the
+   thread number. */
+static void *
+claim_thread (void *aux)
+{
+  size_t t = (size_t) aux;
+  unsigned seed = t + 1;
+  size_t *held = malloc (sizeof *held * BIT_CNT);
+  size_t held_cnt = 0, i;
+
+  if (held == NULL)
+    {
+      fail ("out of memory", 0);
+      return NULL;
+    }
+
+  for (;;)
+    {
+      size_t cnt = 1 + rand_r (&seed) % 5;
+      size_t start = rand_r (&seed) % 2 ? 0 : rand_r (&seed) % BIT_CNT;
+      size_t idx = bitmap_scan_and_flip_atomic (bitmap, start, cnt, false);
+
+      if (idx == BITMAP_ERROR)
+        {
+          /* Groups may still fit before START, or at all in
+             smaller sizes. */
+          if (bitmap_scan (bitmap, 0, 1, false) == BITMAP_ERROR)
+            break;
+          continue;
+        }
+      for (i = 0; i < cnt; i++)
+        held[held_cnt++] = idx + i;
+
+      if (rand_r (&seed) % 4 == 0)
+        bitmap_reset (bitmap, held[--held_cnt]);
+    }
+
+  for (i = 0; i < held_cnt; i++)
+    {
+      unsigned char prev = __atomic_exchange_n (&owner[held[i]], t + 1,
+                                                __ATOMIC_RELAXED);
+      if (prev != 0)
+        fail ("bit claimed twice", held[i]);
+    }
+  free (held);
+  return NULL;
+}
+
+/* Claiming from a summarized bitmap.
+
+   The bitmap starts full except for CHURN_FREE_CNT bits, spread
+   far apart, and every thread repeatedly claims one false bit
+   with bitmap_scan_and_flip_atomic() and gives it back.  The
+   summary entries above the free bits keep flipping between full
+   and not full, so scans walking down the summary race with
+   other threads' updates to it.  Each thread holds at most one
+   bit, so some bits are always free; a scan may still miss them
+   now and then, as they move behind it, but never for long. */
+
+/* Number of bits that start out free. */
+#define CHURN_FREE_CNT (2 * THREAD_CNT)
+
+/* Number of claims per thread. */
+#define CHURN_OP_CNT 200000
+
+/* Number of failed scans in a row that counts as losing track of
+   the free bits. */
+#define CHURN_MAX_MISSES 100000
+
+/* Value of owner[] for bits that are never free. */
+#define NEVER_FREE 0xff
+
+/* Thread function for the claiming test.  AUX is the thread
+   number. */
+static void *
+churn_thread (void *aux)
+{
+  size_t t = (size_t) aux;
+  size_t i, misses = 0;
+
+  for (i = 0; i < CHURN_OP_CNT; i++)
+    {
+      size_t idx = bitmap_scan_and_flip_atomic (bitmap, 0, 1, false);
+      unsigned char prev;
+
+      if (idx == BITMAP_ERROR)
+        {
+          if (++misses >= CHURN_MAX_MISSES)
+            {
+              fail ("no false bit found while some were free", 0);
+              return NULL;
+            }
+          continue;
+        }
+      misses = 0;
+      if (idx >= BIT_CNT)
+        {
+          fail ("claimed bit out of range", idx);
+          return NULL;
+        }
+
+      prev = __atomic_exchange_n (&owner[idx], t + 1, __ATOMIC_ACQ_REL);
+      if (prev != 0)
+        {
+          fail (prev == NEVER_FREE ? "claimed a bit that was set"
+                : "bit claimed twice", idx);
+          return NULL;
+        }
+      __atomic_store_n (&owner[idx], 0, __ATOMIC_RELEASE);
+      bitmap_reset (bitmap, idx);
+    }
+  return NULL;
+}
+
+/* Fills the bitmap, and owner[], for the claiming test. */
+static void
+churn_setup (void)
+{
+  size_t i;
+
+  bitmap_set_all (bitmap, true);
+  for (i = 0; i < BIT_CNT; i++)
+    owner[i] = NEVER_FREE;
+  for (i = 0; i < CHURN_FREE_CNT; i++)
+    {
+      size_t idx = i * (BIT_CNT / CHURN_FREE_CNT) + i;
+      bitmap_reset (bitmap, idx);
+      owner[idx] = 0;
+    }
+}
+
+/* Test driver. */
+
+/* Checks that scanning the bitmap for false bits, which uses
+   its summary if it has one, finds the same bits as testing them
+   one by one. */
+static void
+check_scan (void)
+{
+  size_t expect, idx;
+
+  for (idx = 0; ; idx = expect + 1)
+    {
+      expect = idx;
+      while (expect < BIT_CNT && bitmap_test (bitmap, expect))
+        expect++;
+      if (bitmap_scan (bitmap, idx, 1, false)
+          != (expect < BIT_CNT ? expect : BITMAP_ERROR))
+        {
+          fail ("scan disagrees with bits", idx);
+          return;
+        }
+      if (expect >= BIT_CNT)
+        return;
+    }
+}
+
+/* Runs THREAD_CNT copies of FUNC on a fresh bitmap, with a
+   summary index if SUMMARY is true, and checks the result. */
+static void
+run_test (const char *name, void *(*func) (void *), bool summary)
+{
+  pthread_t threads[THREAD_CNT];
+  size_t t, i;
+
+  bitmap = bitmap_create (BIT_CNT);
+  if (bitmap == NULL || (summary && !bitmap_enable_summary (bitmap)))
+    {
+      fail ("out of memory", 0);
+      return;
+    }
+  for (i = 0; i < BIT_CNT; i++)
+    owner[i] = 0;
+  if (func == churn_thread)
+    churn_setup ();
+
+  for (t = 0; t < THREAD_CNT; t++)
+    if (pthread_create (&threads[t], NULL, func, (void *) t) != 0)
+      {
+        fail ("pthread_create", t);
+        exit (EXIT_FAILURE);
+      }
+  for (t = 0; t < THREAD_CNT; t++)
+    pthread_join (threads[t], NULL);
+
+  if (func == claim_thread)
+    for (i = 0; i < BIT_CNT; i++)
+      if (bitmap_test (bitmap, i) != (owner[i] != 0))
+        fail ("bit set but not held, or held but not set", i);
+  if (func == churn_thread)
+    for (i = 0; i < BIT_CNT; i++)
+      if (bitmap_test (bitmap, i) != (owner[i] == NEVER_FREE))
+        fail ("free bit not given back", i);
+  check_scan ();
+
+  printf ("%s, %s summary: %s\n", name, summary ? "with" : "without",
+          failed ? "failed" : "ok");
+  bitmap_destroy (bitmap);
+}
+
+int
+main (void)
+{
+  if (sysconf (_SC_NPROCESSORS_ONLN) < 2)
+    printf ("note: only one CPU, so threads cannot race; "
+            "run on an SMP machine for a meaningful result\n");
+
+  run_test ("single-bit operations", single_bit_thread, false);
+  run_test ("single-bit operations", single_bit_thread, true);
+  run_test ("group allocation", claim_thread, false);
+  run_test ("group allocation", claim_thread, true);
+  run_test ("claiming from a summarized bitmap", churn_thread, true);
+
+  printf ("%s\n", failed ? "FAIL" : "PASS");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
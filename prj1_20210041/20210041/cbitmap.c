@@ -0,0 +1,1128 @@
+/* Compressed bitmap.
+
+   See cbitmap.h for basic information. */
+
+#include "cbitmap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Number of bits in a chunk. */
+#define CHUNK_BITS 65536
+
+/* Number of 64-bit words in a bitset container. */
+#define BITSET_WORDS (CHUNK_BITS / 64)
+
+/* Largest array container.  Past this, a bitset is smaller. */
+#define ARRAY_MAX 4096
+
+/* Largest run container.  Past this, a bitset is smaller. */
+#define RUN_MAX 2048
+
+/* A run of set bits START through LAST, inclusive. */
+struct run
+  {
+    uint16_t start;
+    uint16_t last;
+  };
+
+/* Ways of storing the set bits of one chunk. */
+enum container_type
+  {
+    CONTAINER_ARRAY,    /* Sorted array of set bits. */
+    CONTAINER_BITSET,   /* One bit per bit, BITSET_WORDS words. */
+    CONTAINER_RUN       /* Sorted runs of set bits. */
+  };
+
+/* The set bits of one chunk.
+
+   Runs in a run container never overlap or touch: there is always
+   at least one false bit between two runs. */
+struct container
+  {
+    enum container_type type;
+    uint32_t card;              /* Number of set bits. */
+    uint32_t len;               /* Values in array, or runs. */
+    uint32_t cap;               /* Allocated values or runs. */
+    union
+      {
+        uint16_t *array;        /* CONTAINER_ARRAY. */
+        uint64_t *words;        /* CONTAINER_BITSET. */
+        struct run *runs;       /* CONTAINER_RUN. */
+      };
+  };
+
+/* A chunk that has at least one set bit. */
+struct chunk
+  {
+    size_t key;                 /* Bit index / CHUNK_BITS. */
+    struct container c;         /* The chunk's set bits. */
+  };
+
+/* Compressed bitmap.  CHUNKS holds only the chunks that have set
+   bits, sorted by key. */
+struct cbitmap
+  {
+    size_t bit_cnt;             /* Number of bits. */
+    size_t chunk_cnt;           /* Number of chunks in use. */
+    size_t chunk_cap;           /* Number of chunks allocated. */
+    struct chunk *chunks;       /* Chunks in use. */
+  };
+
+/* Returns a mask with bits LO through HI of a 64-bit word set,
+   where LO <= HI < 64. */
+static inline uint64_t
+word_mask (unsigned lo, unsigned hi)
+{
+  return (UINT64_MAX << lo) & (UINT64_MAX >> (63 - hi));
+}
+
+/* Containers. */
+
+/* Returns the index of the first value in array container C that
+   is at least X. */
+static uint32_t
+array_lower_bound (const struct container *c, uint32_t x)
+{
+  uint32_t lo = 0, hi = c->len;
+
+  while (lo < hi)
+    {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (c->array[mid] < x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Returns the index of the first run in run container C whose
+   last bit is at least X.  That run contains X if its start is
+   at most X. */
+static uint32_t
+run_find (const struct container *c, uint32_t x)
+{
+  uint32_t lo = 0, hi = c->len;
+
+  while (lo < hi)
+    {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (c->runs[mid].last < x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Returns the first bit at or after X in bitset WORDS that is set
+   to VALUE, or CHUNK_BITS if there is none. */
+static uint32_t
+bitset_next (const uint64_t *words, uint32_t x, bool value)
+{
+  uint64_t flip = value ? 0 : UINT64_MAX;
+  uint32_t w = x / 64;
+  uint64_t e;
+
+  if (x >= CHUNK_BITS)
+    return CHUNK_BITS;
+  e = (words[w] ^ flip) & (UINT64_MAX << (x % 64));
+  while (e == 0)
+    {
+      if (++w == BITSET_WORDS)
+        return CHUNK_BITS;
+      e = words[w] ^ flip;
+    }
+  return w * 64 + __builtin_ctzll (e);
+}
+
+/* Sets bits LO through HI, inclusive, of bitset WORDS to VALUE. */
+static void
+bitset_set_range (uint64_t *words, uint32_t lo, uint32_t hi, bool value)
+{
+  uint32_t w;
+
+  for (w = lo / 64; w <= hi / 64; w++)
+    {
+      uint64_t mask = word_mask (w == lo / 64 ? lo % 64 : 0,
+                                 w == hi / 64 ? hi % 64 : 63);
+      if (value)
+        words[w] |= mask;
+      else
+        words[w] &= ~mask;
+    }
+}
+
+/* Returns true if bit X is set in C. */
+static bool
+container_test (const struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  switch (c->type)
+    {
+    case CONTAINER_ARRAY:
+      i = array_lower_bound (c, x);
+      return i < c->len && c->array[i] == x;
+    case CONTAINER_BITSET:
+      return (c->words[x / 64] >> (x % 64)) & 1;
+    default:
+      i = run_find (c, x);
+      return i < c->len && c->runs[i].start <= x;
+    }
+}
+
+/* Returns the first set bit at or after X in C, or CHUNK_BITS if
+   there is none. */
+static uint32_t
+container_next_set (const struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  switch (c->type)
+    {
+    case CONTAINER_ARRAY:
+      i = array_lower_bound (c, x);
+      return i < c->len ? c->array[i] : CHUNK_BITS;
+    case CONTAINER_BITSET:
+      return bitset_next (c->words, x, true);
+    default:
+      i = run_find (c, x);
+      if (i == c->len)
+        return CHUNK_BITS;
+      return c->runs[i].start > x ? c->runs[i].start : x;
+    }
+}
+
+/* Returns the first unset bit at or after X in C, or CHUNK_BITS
+   if there is none. */
+static uint32_t
+container_next_clear (const struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  switch (c->type)
+    {
+    case CONTAINER_ARRAY:
+      for (i = array_lower_bound (c, x); i < c->len && c->array[i] == x; i++)
+        x++;
+      return x;
+    case CONTAINER_BITSET:
+      return bitset_next (c->words, x, false);
+    default:
+      i = run_find (c, x);
+      if (i < c->len && c->runs[i].start <= x)
+        return (uint32_t) c->runs[i].last + 1;
+      return x;
+    }
+}
+
+/* Returns the number of set bits in C from LO through HI,
+   inclusive. */
+static uint32_t
+container_count (const struct container *c, uint32_t lo, uint32_t hi)
+{
+  uint32_t i, cnt = 0;
+
+  switch (c->type)
+    {
+    case CONTAINER_ARRAY:
+      return array_lower_bound (c, hi + 1) - array_lower_bound (c, lo);
+    case CONTAINER_BITSET:
+      for (i = lo / 64; i <= hi / 64; i++)
+        cnt += __builtin_popcountll (c->words[i]
+                                     & word_mask (i == lo / 64 ? lo % 64 : 0,
+                                                  i == hi / 64 ? hi % 64 : 63));
+      return cnt;
+    default:
+      for (i = run_find (c, lo); i < c->len && c->runs[i].start <= hi; i++)
+        {
+          uint32_t first = c->runs[i].start > lo ? c->runs[i].start : lo;
+          uint32_t last = c->runs[i].last < hi ? c->runs[i].last : hi;
+          cnt += last - first + 1;
+        }
+      return cnt;
+    }
+}
+
+/* Frees the storage owned by C. */
+static void
+container_free (struct container *c)
+{
+  /* All three union members share one pointer. */
+  free (c->words);
+  c->words = NULL;
+}
+
+/* Converts C into a bitset container.  Returns false if memory
+   allocation failed, in which case C is unchanged. */
+static bool
+container_to_bitset (struct container *c)
+{
+  uint64_t *words;
+  uint32_t i;
+
+  if (c->type == CONTAINER_BITSET)
+    return true;
+
+  words = calloc (BITSET_WORDS, sizeof *words);
+  if (words == NULL)
+    return false;
+  if (c->type == CONTAINER_ARRAY)
+    for (i = 0; i < c->len; i++)
+      words[c->array[i] / 64] |= (uint64_t) 1 << (c->array[i] % 64);
+  else
+    for (i = 0; i < c->len; i++)
+      bitset_set_range (words, c->runs[i].start, c->runs[i].last, true);
+
+  container_free (c);
+  c->type = CONTAINER_BITSET;
+  c->words = words;
+  c->len = c->cap = 0;
+  return true;
+}
+
+/* Converts C into whichever of the three container types stores
+   its bits in the fewest bytes.  Recomputes C's cardinality along
+   the way, so it may be used after changing a bitset's words
+   directly.  If memory allocation fails, C is left in a larger
+   form than necessary, which is still correct. */
+static void
+container_shrink (struct container *c)
+{
+  uint64_t *words;
+  uint32_t card = 0, run_cnt = 0, i, x;
+  uint64_t prev_top = 0;
+
+  if (!container_to_bitset (c))
+    return;
+  words = c->words;
+
+  /* A run starts at every set bit whose lower neighbor is
+     unset. */
+  for (i = 0; i < BITSET_WORDS; i++)
+    {
+      card += __builtin_popcountll (words[i]);
+      run_cnt += __builtin_popcountll (words[i] & ~((words[i] << 1) | prev_top));
+      prev_top = words[i] >> 63;
+    }
+  c->card = card;
+
+  if (run_cnt <= RUN_MAX && run_cnt * sizeof (struct run) <= card * 2)
+    {
+      struct run *runs = malloc (sizeof *runs * (run_cnt ? run_cnt : 1));
+
+      if (runs == NULL)
+        return;
+      for (i = 0, x = 0; i < run_cnt; i++)
+        {
+          runs[i].start = bitset_next (words, x, true);
+          x = bitset_next (words, runs[i].start, false);
+          runs[i].last = x - 1;
+        }
+      free (words);
+      c->type = CONTAINER_RUN;
+      c->runs = runs;
+      c->len = c->cap = run_cnt;
+    }
+  else if (card <= ARRAY_MAX)
+    {
+      uint16_t *array = malloc (sizeof *array * (card ? card : 1));
+
+      if (array == NULL)
+        return;
+      for (i = 0, x = 0; i < card; i++, x++)
+        array[i] = x = bitset_next (words, x, true);
+      free (words);
+      c->type = CONTAINER_ARRAY;
+      c->array = array;
+      c->len = c->cap = card;
+    }
+}
+
+/* Makes room for at least LEN values or runs in C, an array or
+   run container.  Returns false if memory allocation failed, in
+   which case C is unchanged. */
+static bool
+container_reserve (struct container *c, uint32_t len)
+{
+  size_t elem_size = (c->type == CONTAINER_ARRAY
+                      ? sizeof *c->array : sizeof *c->runs);
+
+  if (len > c->cap)
+    {
+      uint32_t cap = c->cap ? c->cap * 2 : 4;
+      void *p;
+
+      if (cap < len)
+        cap = len;
+      p = realloc (c->words, elem_size * cap);
+
+      if (p == NULL)
+        return false;
+      c->words = p;
+      c->cap = cap;
+    }
+  return true;
+}
+
+/* Sets bit X in C.  Returns false if memory allocation failed, in
+   which case C is unchanged. */
+static bool
+container_add (struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  if (c->type == CONTAINER_ARRAY)
+    {
+      i = array_lower_bound (c, x);
+      if (i < c->len && c->array[i] == x)
+        return true;
+      if (c->len < ARRAY_MAX)
+        {
+          if (!container_reserve (c, c->len + 1))
+            return false;
+          memmove (c->array + i + 1, c->array + i,
+                   sizeof *c->array * (c->len - i));
+          c->array[i] = x;
+          c->len++;
+          c->card++;
+          return true;
+        }
+      if (!container_to_bitset (c))
+        return false;
+    }
+  else if (c->type == CONTAINER_RUN)
+    {
+      bool join_prev, join_next;
+
+      i = run_find (c, x);
+      if (i < c->len && c->runs[i].start <= x)
+        return true;
+
+      join_prev = i > 0 && (uint32_t) c->runs[i - 1].last + 1 == x;
+      join_next = i < c->len && c->runs[i].start == x + 1;
+      if (join_prev && join_next)
+        {
+          c->runs[i - 1].last = c->runs[i].last;
+          memmove (c->runs + i, c->runs + i + 1,
+                   sizeof *c->runs * (c->len - i - 1));
+          c->len--;
+        }
+      else if (join_prev)
+        c->runs[i - 1].last = x;
+      else if (join_next)
+        c->runs[i].start = x;
+      else if (c->len < RUN_MAX)
+        {
+          if (!container_reserve (c, c->len + 1))
+            return false;
+          memmove (c->runs + i + 1, c->runs + i,
+                   sizeof *c->runs * (c->len - i));
+          c->runs[i].start = c->runs[i].last = x;
+          c->len++;
+        }
+      else
+        return container_to_bitset (c) && container_add (c, x);
+      c->card++;
+      return true;
+    }
+
+  if (!((c->words[x / 64] >> (x % 64)) & 1))
+    {
+      c->words[x / 64] |= (uint64_t) 1 << (x % 64);
+      c->card++;
+    }
+  return true;
+}
+
+/* Clears bit X in C.  Returns false if memory allocation failed,
+   in which case C is unchanged. */
+static bool
+container_remove (struct container *c, uint32_t x)
+{
+  uint32_t i;
+
+  if (c->type == CONTAINER_ARRAY)
+    {
+      i = array_lower_bound (c, x);
+      if (i < c->len && c->array[i] == x)
+        {
+          memmove (c->array + i, c->array + i + 1,
+                   sizeof *c->array * (c->len - i - 1));
+          c->len--;
+          c->card--;
+        }
+    }
+  else if (c->type == CONTAINER_RUN)
+    {
+      struct run *r;
+
+      i = run_find (c, x);
+      if (i == c->len || c->runs[i].start > x)
+        return true;
+
+      r = &c->runs[i];
+      if (r->start == r->last)
+        {
+          memmove (c->runs + i, c->runs + i + 1,
+                   sizeof *c->runs * (c->len - i - 1));
+          c->len--;
+        }
+      else if (r->start == x)
+        r->start++;
+      else if (r->last == x)
+        r->last--;
+      else if (c->len < RUN_MAX)
+        {
+          /* Split the run around X. */
+          if (!container_reserve (c, c->len + 1))
+            return false;
+          r = &c->runs[i];
+          memmove (c->runs + i + 2, c->runs + i + 1,
+                   sizeof *c->runs * (c->len - i - 1));
+          c->runs[i + 1].start = x + 1;
+          c->runs[i + 1].last = r->last;
+          r->last = x - 1;
+          c->len++;
+        }
+      else
+        return container_to_bitset (c) && container_remove (c, x);
+      c->card--;
+    }
+  else if ((c->words[x / 64] >> (x % 64)) & 1)
+    {
+      c->words[x / 64] &= ~((uint64_t) 1 << (x % 64));
+      c->card--;
+
+      /* Go back to a smaller form once the bitset is well below
+         the point where it took over, so that a chunk hovering
+         around ARRAY_MAX doesn't convert back and forth. */
+      if (c->card <= ARRAY_MAX / 2)
+        container_shrink (c);
+    }
+  return true;
+}
+
+/* Converts C, an array container, into a run container, if it
+   has fewer than RUN_MAX runs.  Returns false if it doesn't or if
+   memory allocation failed, in which case C is unchanged. */
+static bool
+container_array_to_run (struct container *c)
+{
+  struct run *runs;
+  uint32_t run_cnt = 0, i, j;
+
+  for (i = 0; i < c->len; i++)
+    if (i == 0 || c->array[i] != c->array[i - 1] + 1)
+      run_cnt++;
+  if (run_cnt >= RUN_MAX)
+    return false;
+
+  runs = malloc (sizeof *runs * (run_cnt ? run_cnt : 1));
+  if (runs == NULL)
+    return false;
+  for (i = 0, j = 0; i < c->len; i++)
+    if (i == 0 || c->array[i] != c->array[i - 1] + 1)
+      runs[j].start = runs[j].last = c->array[i], j++;
+    else
+      runs[j - 1].last = c->array[i];
+
+  container_free (c);
+  c->type = CONTAINER_RUN;
+  c->runs = runs;
+  c->len = c->cap = run_cnt;
+  return true;
+}
+
+/* Sets bits LO through HI, inclusive, of C to VALUE.  Array and
+   run containers are updated in place, in time proportional to
+   the values or runs that move, and only become bitsets when
+   they would outgrow ARRAY_MAX or RUN_MAX.  Returns false if
+   memory allocation failed, in which case C is unchanged. */
+static bool
+container_set_range (struct container *c, uint32_t lo, uint32_t hi,
+                     bool value)
+{
+  uint32_t i, j, k;
+
+  if (c->type == CONTAINER_ARRAY)
+    {
+      uint32_t new_len;
+
+      i = array_lower_bound (c, lo);
+      j = array_lower_bound (c, hi + 1);
+      new_len = value ? c->len - (j - i) + (hi - lo + 1) : c->len - (j - i);
+      if (new_len <= ARRAY_MAX)
+        {
+          uint32_t add = value ? hi - lo + 1 : 0;
+
+          if (!container_reserve (c, new_len))
+            return false;
+          memmove (c->array + i + add, c->array + j,
+                   sizeof *c->array * (c->len - j));
+          for (k = 0; k < add; k++)
+            c->array[i + k] = lo + k;
+          c->len = c->card = new_len;
+          return true;
+        }
+
+      /* Too many values for an array.  A long range of set bits
+         is cheapest as a run, so try that before a bitset. */
+      if (!container_array_to_run (c) && !container_to_bitset (c))
+        return false;
+    }
+
+  if (c->type == CONTAINER_RUN)
+    {
+      struct run new[2];
+      uint32_t new_cnt = 0, old_card = 0;
+
+      /* Runs I through J - 1 are replaced by the NEW_CNT runs in
+         NEW.  Setting bits merges every run that overlaps or
+         touches LO...HI into one; clearing them trims the runs
+         that overlap it, which may split one run in two. */
+      i = run_find (c, value && lo > 0 ? lo - 1 : lo);
+      for (j = i; j < c->len && c->runs[j].start <= (value ? hi + 1 : hi); j++)
+        {
+          uint32_t first = c->runs[j].start > lo ? c->runs[j].start : lo;
+          uint32_t last = c->runs[j].last < hi ? c->runs[j].last : hi;
+          if (first <= last)
+            old_card += last - first + 1;
+        }
+      if (value)
+        {
+          new[0].start = i < j && c->runs[i].start < lo ? c->runs[i].start : lo;
+          new[0].last = i < j && c->runs[j - 1].last > hi ? c->runs[j - 1].last : hi;
+          new_cnt = 1;
+        }
+      else if (i < j)
+        {
+          if (c->runs[i].start < lo)
+            {
+              new[new_cnt].start = c->runs[i].start;
+              new[new_cnt++].last = lo - 1;
+            }
+          if (c->runs[j - 1].last > hi)
+            {
+              new[new_cnt].start = hi + 1;
+              new[new_cnt++].last = c->runs[j - 1].last;
+            }
+        }
+
+      if (new_cnt <= j - i || c->len < RUN_MAX)
+        {
+          if (!container_reserve (c, c->len - (j - i) + new_cnt))
+            return false;
+          memmove (c->runs + i + new_cnt, c->runs + j,
+                   sizeof *c->runs * (c->len - j));
+          for (k = 0; k < new_cnt; k++)
+            c->runs[i + k] = new[k];
+          c->len = c->len - (j - i) + new_cnt;
+          c->card = c->card - old_card + (value ? hi - lo + 1 : 0);
+          return true;
+        }
+      if (!container_to_bitset (c))
+        return false;
+    }
+
+  /* Bitset.  Go back to a smaller form once the bitset is well
+     below the point where it took over, as container_remove()
+     does. */
+  k = container_count (c, lo, hi);
+  bitset_set_range (c->words, lo, hi, value);
+  c->card = value ? c->card - k + (hi - lo + 1) : c->card - k;
+  if (c->card <= ARRAY_MAX / 2)
+    container_shrink (c);
+  return true;
+}
+
+/* Returns the number of bytes of storage owned by C. */
+static size_t
+container_mem_size (const struct container *c)
+{
+  switch (c->type)
+    {
+    case CONTAINER_ARRAY:
+      return sizeof *c->array * c->cap;
+    case CONTAINER_BITSET:
+      return sizeof *c->words * BITSET_WORDS;
+    default:
+      return sizeof *c->runs * c->cap;
+    }
+}
+
+/* Chunks. */
+
+/* Returns the index of the first chunk in B whose key is at
+   least KEY. */
+static size_t
+chunk_lower_bound (const struct cbitmap *b, size_t key)
+{
+  size_t lo = 0, hi = b->chunk_cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (b->chunks[mid].key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Returns the container for chunk KEY in B, or a null pointer if
+   that chunk has no set bits. */
+static struct container *
+find_container (const struct cbitmap *b, size_t key)
+{
+  size_t i = chunk_lower_bound (b, key);
+  return i < b->chunk_cnt && b->chunks[i].key == key ? &b->chunks[i].c : NULL;
+}
+
+/* Returns the index of chunk KEY in B, adding an empty chunk
+   for it if it has none.  Returns BITMAP_ERROR if memory
+   allocation failed. */
+static size_t
+get_chunk (struct cbitmap *b, size_t key)
+{
+  size_t i = chunk_lower_bound (b, key);
+  struct chunk *ch;
+
+  if (i < b->chunk_cnt && b->chunks[i].key == key)
+    return i;
+
+  if (b->chunk_cnt == b->chunk_cap)
+    {
+      size_t cap = b->chunk_cap ? b->chunk_cap * 2 : 4;
+      struct chunk *chunks = realloc (b->chunks, sizeof *chunks * cap);
+
+      if (chunks == NULL)
+        return BITMAP_ERROR;
+      b->chunks = chunks;
+      b->chunk_cap = cap;
+    }
+  memmove (b->chunks + i + 1, b->chunks + i,
+           sizeof *b->chunks * (b->chunk_cnt - i));
+  b->chunk_cnt++;
+
+  ch = &b->chunks[i];
+  ch->key = key;
+  memset (&ch->c, 0, sizeof ch->c);
+  ch->c.type = CONTAINER_ARRAY;
+  return i;
+}
+
+/* Removes chunk I from B if it no longer has any set bits. */
+static void
+drop_chunk_if_empty (struct cbitmap *b, size_t i)
+{
+  if (b->chunks[i].c.card != 0)
+    return;
+  container_free (&b->chunks[i].c);
+  memmove (b->chunks + i, b->chunks + i + 1,
+           sizeof *b->chunks * (b->chunk_cnt - i - 1));
+  b->chunk_cnt--;
+
+  /* Give back chunk slots once most of them are unused.  If
+     that fails, the slots are simply kept. */
+  if (b->chunk_cap > 4 && b->chunk_cnt < b->chunk_cap / 4)
+    {
+      struct chunk *chunks = realloc (b->chunks,
+                                      sizeof *chunks * (b->chunk_cap / 2));
+      if (chunks != NULL)
+        {
+          b->chunks = chunks;
+          b->chunk_cap /= 2;
+        }
+    }
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none. */
+static size_t
+find_next_bit (const struct cbitmap *b, size_t start, size_t end, bool value)
+{
+  if (value)
+    {
+      size_t i;
+
+      for (i = chunk_lower_bound (b, start / CHUNK_BITS); i < b->chunk_cnt; i++)
+        {
+          size_t base = b->chunks[i].key * CHUNK_BITS;
+          uint32_t x;
+
+          if (base >= end)
+            break;
+          x = container_next_set (&b->chunks[i].c,
+                                  base < start ? start - base : 0);
+          if (x < CHUNK_BITS)
+            return base + x < end ? base + x : end;
+        }
+    }
+  else
+    {
+      /* Missing chunks are all false, so only runs of present
+         chunks that are full to their end need skipping. */
+      while (start < end)
+        {
+          size_t key = start / CHUNK_BITS;
+          const struct container *c = find_container (b, key);
+          uint32_t x;
+
+          if (c == NULL)
+            return start;
+          x = container_next_clear (c, start % CHUNK_BITS);
+          if (x < CHUNK_BITS)
+            return key * CHUNK_BITS + x < end ? key * CHUNK_BITS + x : end;
+          start = (key + 1) * CHUNK_BITS;
+        }
+    }
+  return end;
+}
+
+/* Creation and destruction. */
+
+/* Creates and returns a compressed bitmap of BIT_CNT bits, all
+   set to false.  Returns a null pointer if memory allocation
+   fails. */
+struct cbitmap *
+cbitmap_create (size_t bit_cnt)
+{
+  struct cbitmap *b = malloc (sizeof *b);
+  if (b != NULL)
+    {
+      b->bit_cnt = bit_cnt;
+      b->chunk_cnt = b->chunk_cap = 0;
+      b->chunks = NULL;
+    }
+  return b;
+}
+
+/* Destroys compressed bitmap B, freeing its storage. */
+void
+cbitmap_destroy (struct cbitmap *b)
+{
+  if (b != NULL)
+    {
+      size_t i;
+
+      for (i = 0; i < b->chunk_cnt; i++)
+        container_free (&b->chunks[i].c);
+      free (b->chunks);
+      free (b);
+    }
+}
+
+/* Bitmap size. */
+
+/* Returns the number of bits in B. */
+size_t
+cbitmap_size (const struct cbitmap *b)
+{
+  return b->bit_cnt;
+}
+
+/* Setting and testing single bits. */
+
+/* Sets the bit numbered IDX in B to VALUE.  Returns false if
+   memory allocation failed, in which case B is unchanged. */
+bool
+cbitmap_set (struct cbitmap *b, size_t idx, bool value)
+{
+  if (value)
+    return cbitmap_mark (b, idx);
+  else
+    return cbitmap_reset (b, idx);
+}
+
+/* Sets the bit numbered IDX in B to true.  Returns false if
+   memory allocation failed, in which case B is unchanged. */
+bool
+cbitmap_mark (struct cbitmap *b, size_t idx)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+
+  i = get_chunk (b, idx / CHUNK_BITS);
+  if (i == BITMAP_ERROR)
+    return false;
+  if (!container_add (&b->chunks[i].c, idx % CHUNK_BITS))
+    {
+      drop_chunk_if_empty (b, i);
+      return false;
+    }
+  return true;
+}
+
+/* Sets the bit numbered IDX in B to false.  Returns false if
+   memory allocation failed, in which case B is unchanged. */
+bool
+cbitmap_reset (struct cbitmap *b, size_t idx)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+
+  i = chunk_lower_bound (b, idx / CHUNK_BITS);
+  if (i < b->chunk_cnt && b->chunks[i].key == idx / CHUNK_BITS)
+    {
+      if (!container_remove (&b->chunks[i].c, idx % CHUNK_BITS))
+        return false;
+      drop_chunk_if_empty (b, i);
+    }
+  return true;
+}
+
+/* Toggles the bit numbered IDX in B.  Returns false if memory
+   allocation failed, in which case B is unchanged. */
+bool
+cbitmap_flip (struct cbitmap *b, size_t idx)
+{
+  return cbitmap_set (b, idx, !cbitmap_test (b, idx));
+}
+
+/* Returns the value of the bit numbered IDX in B. */
+bool
+cbitmap_test (const struct cbitmap *b, size_t idx)
+{
+  const struct container *c;
+
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+
+  c = find_container (b, idx / CHUNK_BITS);
+  return c != NULL && container_test (c, idx % CHUNK_BITS);
+}
+
+/* Setting and testing multiple bits. */
+
+/* Sets all bits in B to VALUE.  Returns false if memory
+   allocation failed, like cbitmap_set_multiple(). */
+bool
+cbitmap_set_all (struct cbitmap *b, bool value)
+{
+  ASSERT (b != NULL);
+
+  return cbitmap_set_multiple (b, 0, b->bit_cnt, value);
+}
+
+/* Sets the CNT bits starting at START in B to VALUE.  Chunks
+   covered completely become a single run or disappear; partly
+   covered chunks are updated in place, keeping their form unless
+   they outgrow it, like single-bit updates.  Returns false if memory allocation
+   failed, in which case the chunks before the one that failed
+   have been updated and the rest are unchanged. */
+bool
+cbitmap_set_multiple (struct cbitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t key, last_key;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+
+  last_key = (start + cnt - 1) / CHUNK_BITS;
+  for (key = start / CHUNK_BITS; key <= last_key; key++)
+    {
+      size_t base = key * CHUNK_BITS;
+      uint32_t lo = start > base ? start - base : 0;
+      uint32_t hi = start + cnt - 1 < base + CHUNK_BITS - 1
+                    ? start + cnt - 1 - base : CHUNK_BITS - 1;
+      struct container *c;
+      size_t i;
+
+      if (!value && find_container (b, key) == NULL)
+        continue;
+
+      i = get_chunk (b, key);
+      if (i == BITMAP_ERROR)
+        return false;
+      c = &b->chunks[i].c;
+      if (lo == 0 && hi == CHUNK_BITS - 1)
+        {
+          struct run *run = NULL;
+
+          if (value && (run = malloc (sizeof *run)) == NULL)
+            {
+              drop_chunk_if_empty (b, i);
+              return false;
+            }
+          container_free (c);
+          c->len = c->cap = c->card = 0;
+          c->type = CONTAINER_ARRAY;
+          if (value)
+            {
+              c->type = CONTAINER_RUN;
+              c->runs = run;
+              c->runs[0].start = 0;
+              c->runs[0].last = CHUNK_BITS - 1;
+              c->len = c->cap = 1;
+              c->card = CHUNK_BITS;
+            }
+        }
+      else if (!container_set_range (c, lo, hi, value))
+        {
+          drop_chunk_if_empty (b, i);
+          return false;
+        }
+      drop_chunk_if_empty (b, i);
+    }
+  return true;
+}
+
+/* Returns the number of bits in B between START and START + CNT,
+   exclusive, that are set to VALUE. */
+size_t
+cbitmap_count (const struct cbitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, true_cnt = 0;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return 0;
+
+  for (i = chunk_lower_bound (b, start / CHUNK_BITS); i < b->chunk_cnt; i++)
+    {
+      size_t base = b->chunks[i].key * CHUNK_BITS;
+      uint32_t lo, hi;
+
+      if (base > start + cnt - 1)
+        break;
+      lo = start > base ? start - base : 0;
+      hi = start + cnt - 1 < base + CHUNK_BITS - 1
+           ? start + cnt - 1 - base : CHUNK_BITS - 1;
+      true_cnt += container_count (&b->chunks[i].c, lo, hi);
+    }
+  return value ? true_cnt : cnt - true_cnt;
+}
+
+/* Returns true if any bits in B between START and START + CNT,
+   exclusive, are set to VALUE, and false otherwise. */
+bool
+cbitmap_contains (const struct cbitmap *b, size_t start, size_t cnt,
+                  bool value)
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  return find_next_bit (b, start, start + cnt, value) < start + cnt;
+}
+
+/* Returns true if any bits in B between START and START + CNT,
+   exclusive, are set to true, and false otherwise.*/
+bool
+cbitmap_any (const struct cbitmap *b, size_t start, size_t cnt)
+{
+  return cbitmap_contains (b, start, cnt, true);
+}
+
+/* Returns true if no bits in B between START and START + CNT,
+   exclusive, are set to true, and false otherwise.*/
+bool
+cbitmap_none (const struct cbitmap *b, size_t start, size_t cnt)
+{
+  return !cbitmap_contains (b, start, cnt, true);
+}
+
+/* Returns true if every bit in B between START and START + CNT,
+   exclusive, is set to true, and false otherwise. */
+bool
+cbitmap_all (const struct cbitmap *b, size_t start, size_t cnt)
+{
+  return !cbitmap_contains (b, start, cnt, false);
+}
+
+/* Finding set or unset bits. */
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B at or after START that are all set to
+   VALUE.
+   If there is no such group, returns BITMAP_ERROR. */
+size_t
+cbitmap_scan (const struct cbitmap *b, size_t start, size_t cnt, bool value)
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  if (cnt <= b->bit_cnt)
+    {
+      size_t last = b->bit_cnt - cnt;
+      size_t i = start;
+
+      if (cnt == 0)
+        return i;
+      while (i <= last)
+        {
+          size_t run_end;
+
+          i = find_next_bit (b, i, last + 1, value);
+          if (i > last)
+            break;
+          run_end = find_next_bit (b, i, i + cnt, !value);
+          if (run_end == i + cnt)
+            return i;
+          i = run_end + 1;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Finds the first group of CNT consecutive bits in B at or after
+   START that are all set to VALUE, flips them all to !VALUE,
+   and returns the index of the first bit in the group.
+   If there is no such group, or if memory allocation failed
+   while flipping the bits, returns BITMAP_ERROR.  In the latter
+   case, only some of the group's bits may have been flipped. */
+size_t
+cbitmap_scan_and_flip (struct cbitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t idx = cbitmap_scan (b, start, cnt, value);
+  if (idx != BITMAP_ERROR && !cbitmap_set_multiple (b, idx, cnt, !value))
+    return BITMAP_ERROR;
+  return idx;
+}
+
+/* Storage. */
+
+/* Converts every chunk of B to its smallest form.  Single-bit
+   updates only change a chunk's form when they must, so this is
+   worth calling after many of them. */
+void
+cbitmap_optimize (struct cbitmap *b)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+
+  for (i = 0; i < b->chunk_cnt; i++)
+    container_shrink (&b->chunks[i].c);
+}
+
+/* Returns the number of bytes of memory used by B. */
+size_t
+cbitmap_mem_size (const struct cbitmap *b)
+{
+  size_t i, size;
+
+  ASSERT (b != NULL);
+
+  size = sizeof *b + sizeof *b->chunks * b->chunk_cap;
+  for (i = 0; i < b->chunk_cnt; i++)
+    size += container_mem_size (&b->chunks[i].c);
+  return size;
+}
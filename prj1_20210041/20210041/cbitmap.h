@@ -0,0 +1,56 @@
+#ifndef __MYLIB_CBITMAP_H
+#define __MYLIB_CBITMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "bitmap.h"
+
+/* Compressed bitmap abstract data type.
+
+   Behaves like the bitmap in bitmap.h, but splits the index space
+   into chunks of 65,536 bits and stores each chunk in whichever
+   of three forms is smallest: a sorted array of the set bits, a
+   plain bitset, or a sorted list of runs of set bits.  Chunks with
+   no set bits take no space at all.  Memory use therefore follows
+   the number of set bits (or of runs), not the bit count, which
+   suits huge bitmaps that are mostly empty or mostly full.
+
+   Functions return BITMAP_ERROR from bitmap.h where the
+   corresponding bitmap function does.  Functions that change
+   bits may need to allocate memory; they return false, or
+   BITMAP_ERROR, if that fails. */
+
+/* Creation and destruction. */
+struct cbitmap *cbitmap_create (size_t bit_cnt);
+void cbitmap_destroy (struct cbitmap *);
+
+/* Bitmap size. */
+size_t cbitmap_size (const struct cbitmap *);
+
+/* Setting and testing single bits. */
+bool cbitmap_set (struct cbitmap *, size_t idx, bool);
+bool cbitmap_mark (struct cbitmap *, size_t idx);
+bool cbitmap_reset (struct cbitmap *, size_t idx);
+bool cbitmap_flip (struct cbitmap *, size_t idx);
+bool cbitmap_test (const struct cbitmap *, size_t idx);
+
+/* Setting and testing multiple bits. */
+bool cbitmap_set_all (struct cbitmap *, bool);
+bool cbitmap_set_multiple (struct cbitmap *, size_t start, size_t cnt, bool);
+size_t cbitmap_count (const struct cbitmap *, size_t start, size_t cnt, bool);
+bool cbitmap_contains (const struct cbitmap *, size_t start, size_t cnt, bool);
+bool cbitmap_any (const struct cbitmap *, size_t start, size_t cnt);
+bool cbitmap_none (const struct cbitmap *, size_t start, size_t cnt);
+bool cbitmap_all (const struct cbitmap *, size_t start, size_t cnt);
+
+/* Finding set or unset bits. */
+size_t cbitmap_scan (const struct cbitmap *, size_t start, size_t cnt, bool);
+size_t cbitmap_scan_and_flip (struct cbitmap *, size_t start, size_t cnt,
+                              bool);
+
+/* Storage. */
+void cbitmap_optimize (struct cbitmap *);
+size_t cbitmap_mem_size (const struct cbitmap *);
+
+#endif /* cbitmap.h */
@@ -0,0 +1,296 @@
+/* Concurrent hash table.
+
+   See chash.h for basic information. */
+
+#include "chash.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+#define list_elem_to_hash_elem(LIST_ELEM)                       \
+        list_entry(LIST_ELEM, struct hash_elem, list_elem)
+
+static struct hash_elem *find_elem (struct chash *, struct list *,
+                                    struct hash_elem *, unsigned hash);
+static void resize (struct chash *);
+
+/* Element per bucket ratios.  Tables grow past the maximum and
+   shrink below the minimum, doubling or halving the number of
+   buckets, which leaves them comfortably between the two. */
+#define MIN_ELEMS_PER_BUCKET 1
+#define MAX_ELEMS_PER_BUCKET 4
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX.
+   H must not be used by other threads until this returns. */
+bool
+chash_init (struct chash *h,
+            hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  return chash_init_equal (h, hash, less, NULL, aux);
+}
+
+/* Initializes hash table H like chash_init(), but also takes
+   EQUAL, which, if non-null, is used to test hash elements for
+   equality with a single call instead of two calls to LESS, as
+   in hash_init_equal().  LESS may be null if EQUAL is not. */
+bool
+chash_init_equal (struct chash *h, hash_hash_func *hash,
+                  hash_less_func *less, hash_equal_func *equal, void *aux)
+{
+  size_t i;
+
+  ASSERT (less != NULL || equal != NULL);
+  ASSERT ((uintptr_t) h % CHASH_CACHE_LINE == 0);
+
+  h->elem_cnt = 0;
+  h->bucket_cnt = CHASH_STRIPES;
+  h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->hash = hash;
+  h->less = less;
+  h->equal = equal;
+  h->aux = aux;
+
+  if (h->buckets == NULL)
+    return false;
+  for (i = 0; i < h->bucket_cnt; i++)
+    list_init (&h->buckets[i]);
+  for (i = 0; i < CHASH_STRIPES; i++)
+    pthread_rwlock_init (&h->stripes[i].lock, NULL);
+  return true;
+}
+
+/* Destroys hash table H, which no other thread may be using.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash.  DESTRUCTOR may, if appropriate,
+   deallocate the memory used by the hash element. */
+void
+chash_destroy (struct chash *h, hash_action_func *destructor)
+{
+  size_t i;
+
+  if (destructor != NULL)
+    for (i = 0; i < h->bucket_cnt; i++)
+      while (!list_empty (&h->buckets[i]))
+        {
+          struct list_elem *elem = list_pop_front (&h->buckets[i]);
+          destructor (list_elem_to_hash_elem (elem), h->aux);
+        }
+  free (h->buckets);
+  for (i = 0; i < CHASH_STRIPES; i++)
+    pthread_rwlock_destroy (&h->stripes[i].lock);
+}
+
+/* Returns the lock stripe that guards elements whose hash value
+   is HASH. */
+static inline pthread_rwlock_t *
+stripe_lock (struct chash *h, unsigned hash)
+{
+  return &h->stripes[hash & (CHASH_STRIPES - 1)].lock;
+}
+
+/* Returns the bucket in H that an element whose hash value is
+   HASH belongs in.  The caller must hold HASH's stripe lock. */
+static inline struct list *
+find_bucket (struct chash *h, unsigned hash)
+{
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct hash_elem *
+chash_insert (struct chash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  pthread_rwlock_t *lock = stripe_lock (h, hash);
+  struct list *bucket;
+  struct hash_elem *old;
+  size_t elem_cnt = 0, bucket_cnt;
+
+  pthread_rwlock_wrlock (lock);
+  bucket = find_bucket (h, hash);
+  old = find_elem (h, bucket, new, hash);
+  if (old == NULL)
+    {
+      new->hash = hash;
+      list_push_front (bucket, &new->list_elem);
+      elem_cnt = __atomic_add_fetch (&h->elem_cnt, 1, __ATOMIC_RELAXED);
+    }
+  bucket_cnt = h->bucket_cnt;
+  pthread_rwlock_unlock (lock);
+
+  if (elem_cnt > bucket_cnt * MAX_ELEMS_PER_BUCKET)
+    resize (h);
+  return old;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct hash_elem *
+chash_replace (struct chash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  pthread_rwlock_t *lock = stripe_lock (h, hash);
+  struct list *bucket;
+  struct hash_elem *old;
+  size_t elem_cnt = 0, bucket_cnt;
+
+  pthread_rwlock_wrlock (lock);
+  bucket = find_bucket (h, hash);
+  old = find_elem (h, bucket, new, hash);
+  if (old != NULL)
+    list_remove (bucket, &old->list_elem);
+  else
+    elem_cnt = __atomic_add_fetch (&h->elem_cnt, 1, __ATOMIC_RELAXED);
+  new->hash = hash;
+  list_push_front (bucket, &new->list_elem);
+  bucket_cnt = h->bucket_cnt;
+  pthread_rwlock_unlock (lock);
+
+  if (elem_cnt > bucket_cnt * MAX_ELEMS_PER_BUCKET)
+    resize (h);
+  return old;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct hash_elem *
+chash_find (struct chash *h, struct hash_elem *e)
+{
+  unsigned hash = h->hash (e, h->aux);
+  pthread_rwlock_t *lock = stripe_lock (h, hash);
+  struct hash_elem *found;
+
+  pthread_rwlock_rdlock (lock);
+  found = find_elem (h, find_bucket (h, hash), e, hash);
+  pthread_rwlock_unlock (lock);
+  return found;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table. */
+struct hash_elem *
+chash_delete (struct chash *h, struct hash_elem *e)
+{
+  unsigned hash = h->hash (e, h->aux);
+  pthread_rwlock_t *lock = stripe_lock (h, hash);
+  struct list *bucket;
+  struct hash_elem *found;
+  size_t elem_cnt = 0, bucket_cnt;
+
+  pthread_rwlock_wrlock (lock);
+  bucket = find_bucket (h, hash);
+  found = find_elem (h, bucket, e, hash);
+  if (found != NULL)
+    {
+      list_remove (bucket, &found->list_elem);
+      elem_cnt = __atomic_sub_fetch (&h->elem_cnt, 1, __ATOMIC_RELAXED);
+    }
+  bucket_cnt = h->bucket_cnt;
+  pthread_rwlock_unlock (lock);
+
+  if (found != NULL && bucket_cnt > CHASH_STRIPES
+      && elem_cnt < bucket_cnt * MIN_ELEMS_PER_BUCKET)
+    resize (h);
+  return found;
+}
+
+/* Returns the number of elements in H.  With other threads
+   inserting or deleting, the result may be out of date by the
+   time it is returned. */
+size_t
+chash_size (struct chash *h)
+{
+  return __atomic_load_n (&h->elem_cnt, __ATOMIC_RELAXED);
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+chash_empty (struct chash *h)
+{
+  return chash_size (h) == 0;
+}
+
+/* Returns true if hash elements A and B are equal in H, using
+   its equality function if it has one. */
+static inline bool
+elems_equal (struct chash *h, struct hash_elem *a, struct hash_elem *b)
+{
+  if (h->equal != NULL)
+    return h->equal (a, b, h->aux);
+  return !h->less (a, b, h->aux) && !h->less (b, a, h->aux);
+}
+
+/* Searches BUCKET in H for a hash element equal to E, whose hash
+   value is HASH.  Returns it if found or a null pointer
+   otherwise.  The caller must hold HASH's stripe lock. */
+static struct hash_elem *
+find_elem (struct chash *h, struct list *bucket, struct hash_elem *e,
+           unsigned hash)
+{
+  struct list_elem *i;
+
+  for (i = list_begin (bucket); i != list_end (bucket); i = list_next (i))
+    {
+      struct hash_elem *hi = list_elem_to_hash_elem (i);
+      if (hi->hash == hash && elems_equal (h, hi, e))
+        return hi;
+    }
+  return NULL;
+}
+
+/* Changes the number of buckets in H to fit its current number
+   of elements, if that is still needed once every stripe lock
+   is held; another thread may have resized H in the meantime.
+   This can fail because of an out-of-memory condition, but
+   that'll just make hash accesses less efficient. */
+static void
+resize (struct chash *h)
+{
+  size_t old_bucket_cnt, new_bucket_cnt, elem_cnt;
+  struct list *old_buckets, *new_buckets;
+  size_t i;
+
+  for (i = 0; i < CHASH_STRIPES; i++)
+    pthread_rwlock_wrlock (&h->stripes[i].lock);
+
+  old_buckets = h->buckets;
+  old_bucket_cnt = h->bucket_cnt;
+  elem_cnt = h->elem_cnt;
+
+  new_bucket_cnt = old_bucket_cnt;
+  while (elem_cnt > new_bucket_cnt * MAX_ELEMS_PER_BUCKET)
+    new_bucket_cnt *= 2;
+  while (new_bucket_cnt > CHASH_STRIPES
+         && elem_cnt < new_bucket_cnt * MIN_ELEMS_PER_BUCKET)
+    new_bucket_cnt /= 2;
+
+  if (new_bucket_cnt != old_bucket_cnt
+      && (new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt)) != NULL)
+    {
+      for (i = 0; i < new_bucket_cnt; i++)
+        list_init (&new_buckets[i]);
+      h->buckets = new_buckets;
+      h->bucket_cnt = new_bucket_cnt;
+
+      /* Move each element using its cached hash value. */
+      for (i = 0; i < old_bucket_cnt; i++)
+        while (!list_empty (&old_buckets[i]))
+          {
+            struct list_elem *elem = list_pop_front (&old_buckets[i]);
+            unsigned hash = list_elem_to_hash_elem (elem)->hash;
+            list_push_front (find_bucket (h, hash), elem);
+          }
+      free (old_buckets);
+    }
+
+  for (i = CHASH_STRIPES; i-- > 0; )
+    pthread_rwlock_unlock (&h->stripes[i].lock);
+}
@@ -0,0 +1,81 @@
+#ifndef __MYLIB_CHASH_H
+#define __MYLIB_CHASH_H
+
+/* Concurrent hash table.
+
+   A chained hash table like the one in hash.h, with the same
+   element type, callbacks and insert/find/delete/replace
+   semantics, that any number of threads may use at once without
+   outside locking.
+
+   The buckets are split into CHASH_STRIPES stripes by the low
+   bits of their hash values, and each stripe has a
+   reader-writer lock of its own.  Lookups take their stripe's
+   lock for reading, so they run in parallel with each other and
+   with updates in other stripes; insertions and deletions take
+   it for writing.  Because the number of buckets is always a
+   multiple of the number of stripes, an element stays in the
+   same stripe however many buckets there are.  Resizing takes
+   every stripe's lock, in order.
+
+   An element returned by chash_find() may be deleted by another
+   thread at any time afterward.  If elements are freed after
+   deletion, callers must make sure no other thread still uses
+   them, for example by not freeing elements while the table is
+   shared.
+
+   struct chash is aligned to CHASH_CACHE_LINE bytes.  malloc()
+   does not guarantee that much alignment, so a table on the heap
+   should be allocated with aligned_alloc(). */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* Number of lock stripes, a power of 2. */
+#define CHASH_STRIPES 64
+
+/* Size of a cache line, in bytes. */
+#define CHASH_CACHE_LINE 64
+
+/* A lock stripe, aligned and padded to the size of a cache line
+   so that each stripe has a line to itself and threads working
+   in neighboring stripes mostly don't slow each other down. */
+union chash_stripe
+  {
+    pthread_rwlock_t lock;
+    char pad[CHASH_CACHE_LINE];
+  } __attribute__ ((aligned (CHASH_CACHE_LINE)));
+
+/* Concurrent hash table. */
+struct chash
+  {
+    size_t elem_cnt;            /* Number of elements, updated atomically. */
+    size_t bucket_cnt;          /* Number of buckets, a power of 2. */
+    struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    hash_equal_func *equal;     /* Equality function, or null. */
+    void *aux;                  /* Auxiliary data for the functions. */
+    union chash_stripe stripes[CHASH_STRIPES]; /* Bucket locks. */
+  };
+
+/* Basic life cycle. */
+bool chash_init (struct chash *, hash_hash_func *, hash_less_func *,
+                 void *aux);
+bool chash_init_equal (struct chash *, hash_hash_func *, hash_less_func *,
+                       hash_equal_func *, void *aux);
+void chash_destroy (struct chash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *chash_insert (struct chash *, struct hash_elem *);
+struct hash_elem *chash_replace (struct chash *, struct hash_elem *);
+struct hash_elem *chash_find (struct chash *, struct hash_elem *);
+struct hash_elem *chash_delete (struct chash *, struct hash_elem *);
+
+/* Information. */
+size_t chash_size (struct chash *);
+bool chash_empty (struct chash *);
+
+#endif /* chash.h */
@@ -3,21 +3,69 @@
 See hash.h for basic information. */
 
 #include "hash.h"
+#include "pool.h"
 #include <assert.h>	
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>	
+#include <string.h>
+#include <unistd.h>
 
 #define ASSERT(CONDITION) assert(CONDITION)	
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
         list_entry(LIST_ELEM, struct hash_elem, list_elem)
 
-static struct list *find_bucket (struct hash *, struct hash_elem *);
+/* Element per bucket ratios, used as the default load factors.
+   A table grows once it reaches MAX_ELEMS_PER_BUCKET, which gives
+   the same bucket counts as growing to elem_cnt /
+   BEST_ELEMS_PER_BUCKET, rounded down to a power of 2, as this
+   table used to. */
+#define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
+#define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
+
+/* Fewest buckets a table has, a power of 2. */
+#define MIN_BUCKET_CNT 4
+
+/* Number of old buckets migrated by each insertion, search or
+   deletion while a table is being resized incrementally.  With
+   the default load factors, a resize to or from B buckets only
+   starts once the element count has moved by about B since the
+   previous one, so migrating at least one bucket per operation
+   finishes in time.  With other load factors, a resize that is
+   due simply waits for the previous one to finish. */
+#define REHASH_STEP 4
+
+/* Number of elements in each group that hash_insert_batch() and
+   hash_find_batch() hash and prefetch together.  See
+   run_batch(). */
+#define BATCH_SIZE 16
+
+/* Fewest elements per thread for which hash_apply_parallel()
+   starts another thread, so that small tables aren't slowed down
+   by thread creation. */
+#define MIN_ELEMS_PER_THREAD 4096
+
+static struct list *find_bucket (struct hash *, unsigned hash);
+static struct list *init_bucket (struct list *);
 static struct hash_elem *find_elem (struct hash *, struct list *,
-                                    struct hash_elem *);
-static void insert_elem (struct hash *, struct list *, struct hash_elem *);
-static void remove_elem (struct hash *, struct hash_elem *);
-static void rehash (struct hash *);
+                                    struct hash_elem *, unsigned hash);
+static void insert_elem (struct hash *, struct list *, struct hash_elem *,
+                         unsigned hash);
+static void remove_elem (struct hash *, struct list *, struct hash_elem *);
+static struct hash_elem *lookup (struct hash *, struct hash_elem *,
+                                 unsigned hash, struct list **bucketp);
+static struct hash_elem *insert_hashed (struct hash *, struct hash_elem *,
+                                        unsigned hash);
+static struct hash_elem *find_hashed (struct hash *, struct hash_elem *,
+                                      unsigned hash);
+static void run_batch (struct hash *, struct hash_elem **, size_t cnt,
+                       struct hash_elem **results, bool insert);
+static size_t bucket_cnt_for (const struct hash *, size_t elem_cnt);
+static void rehash (struct hash *, bool may_shrink);
+static bool resize (struct hash *, size_t new_bucket_cnt);
+static void rehash_step (struct hash *, size_t cnt);
+static void finish_rehash (struct hash *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -25,20 +73,46 @@ bool
 hash_init (struct hash *h,
            hash_hash_func *hash, hash_less_func *less, void *aux) 
 {
+  return hash_init_with_capacity (h, 0, hash, less, NULL, aux);
+}
+
+/* Initializes hash table H like hash_init(), but also takes
+   EQUAL, which, if non-null, is used to test hash elements for
+   equality with a single call instead of two calls to LESS.
+   LESS may be null if EQUAL is not. */
+bool
+hash_init_equal (struct hash *h, hash_hash_func *hash, hash_less_func *less,
+                 hash_equal_func *equal, void *aux)
+{
+  return hash_init_with_capacity (h, 0, hash, less, equal, aux);
+}
+
+/* Initializes hash table H like hash_init_equal(), but with
+   enough buckets up front to hold CAPACITY elements without
+   growing, so that loading a known number of elements needs no
+   resizing at all. */
+bool
+hash_init_with_capacity (struct hash *h, size_t capacity,
+                         hash_hash_func *hash, hash_less_func *less,
+                         hash_equal_func *equal, void *aux)
+{
+  ASSERT (less != NULL || equal != NULL);
+
   h->elem_cnt = 0;
-  h->bucket_cnt = 4;
-  h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
   h->hash = hash;
   h->less = less;
+  h->equal = equal;
   h->aux = aux;
-
-  if (h->buckets != NULL) 
-    {
-      hash_clear (h, NULL);
-      return true;
-    }
-  else
-    return false;
+  h->min_load = MIN_ELEMS_PER_BUCKET * 100;
+  h->max_load = MAX_ELEMS_PER_BUCKET * 100;
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->migrate_idx = 0;
+  h->incremental = false;
+  h->bucket_cnt = bucket_cnt_for (h, capacity);
+  h->buckets = calloc (h->bucket_cnt, sizeof *h->buckets);
+
+  return h->buckets != NULL;
 }
 
 /* Removes all the elements from H.
@@ -55,9 +129,10 @@ hash_clear (struct hash *h, hash_action_func *destructor)
 {
   size_t i;
 
+  finish_rehash (h);
   for (i = 0; i < h->bucket_cnt; i++) 
     {
-      struct list *bucket = &h->buckets[i];
+      struct list *bucket = init_bucket (&h->buckets[i]);
 
       if (destructor != NULL) 
         while (!list_empty (bucket)) 
@@ -89,6 +164,66 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
   if (destructor != NULL)
     hash_clear (h, destructor);
   free (h->buckets);
+  free (h->old_buckets);
+}
+
+/* Sets the load factors of hash table H, in elements per 100
+   buckets.  H grows once it holds MAX_LOAD or more elements per
+   100 buckets, and deletions shrink it once it holds fewer
+   than MIN_LOAD.  MAX_LOAD must be more than twice MIN_LOAD, so
+   that doubling or halving the bucket count always lands
+   between the two.  A MIN_LOAD of 0 keeps H from ever
+   shrinking.  The defaults are 100 and 400.  The new factors
+   take effect at the next insertion or deletion. */
+void
+hash_set_load_factors (struct hash *h, unsigned min_load, unsigned max_load)
+{
+  ASSERT (max_load > 0);
+  ASSERT (max_load > 2 * min_load);
+
+  h->min_load = min_load;
+  h->max_load = max_load;
+}
+
+/* Makes sure hash table H has enough buckets to hold CAPACITY
+   elements without growing, resizing it right away if needed.
+   Insertions never shrink H, so the buckets stay reserved until
+   elements are deleted.  Returns false if memory allocation
+   failed, true otherwise. */
+bool
+hash_reserve (struct hash *h, size_t capacity)
+{
+  size_t bucket_cnt = bucket_cnt_for (h, capacity);
+
+  finish_rehash (h);
+  if (bucket_cnt <= h->bucket_cnt)
+    return true;
+  if (!resize (h, bucket_cnt))
+    return false;
+  finish_rehash (h);
+  return true;
+}
+
+/* Selects how hash table H changes its number of buckets.
+
+   By default, the insertion or deletion that takes H past a
+   size threshold moves every element into a new bucket array
+   before returning, which takes time proportional to the size
+   of H.  If INCREMENTAL is true, that operation instead only
+   allocates the new array, and every later insertion, search or
+   deletion moves the elements of a few old buckets across,
+   until the old array is empty and can be freed.  Lookups in the
+   meantime search both arrays.  This keeps the cost of each
+   operation small at the price of some extra work overall.
+
+   Turning incremental resizing off completes any resize that is
+   in progress. */
+void
+hash_set_incremental (struct hash *h, bool incremental)
+{
+  h->incremental = incremental;
+  if (!incremental)
+    finish_rehash (h);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -98,15 +233,23 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 struct hash_elem *
 hash_insert (struct hash *h, struct hash_elem *new)
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
-
-  if (old == NULL) 
-    insert_elem (h, bucket, new);
+  return insert_hashed (h, new, h->hash (new, h->aux));
+}
 
-  rehash (h);
+/* Inserts the CNT elements of ELEMS into hash table H, in order,
+   as if by hash_insert().  If OLDS is non-null, OLDS[i] receives
+   what hash_insert() would have returned for ELEMS[i].
 
-  return old; 
+   Rather than finishing one element before starting on the
+   next, this hashes a group of elements and prefetches their
+   buckets up front, so that the cache misses for different
+   elements overlap.  On tables much larger than the cache, that
+   is considerably faster than separate calls. */
+void
+hash_insert_batch (struct hash *h, struct hash_elem **elems, size_t cnt,
+                   struct hash_elem **olds)
+{
+  run_batch (h, elems, cnt, olds, true);
 }
 
 /* Inserts NEW into hash table H, replacing any equal element
@@ -114,14 +257,15 @@ hash_insert (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_replace (struct hash *h, struct hash_elem *new) 
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  unsigned hash = h->hash (new, h->aux);
+  struct list *bucket;
+  struct hash_elem *old = lookup (h, new, hash, &bucket);
 
   if (old != NULL)
-    remove_elem (h, old);
-  insert_elem (h, bucket, new);
+    remove_elem (h, bucket, old);
+  insert_elem (h, find_bucket (h, hash), new, hash);
 
-  rehash (h);
+  rehash (h, false);
 
   return old;
 }
@@ -131,7 +275,20 @@ hash_replace (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) 
 {
-  return find_elem (h, find_bucket (h, e), e);
+  return find_hashed (h, e, h->hash (e, h->aux));
+}
+
+/* Looks up each of the CNT elements of ELEMS in hash table H, as
+   if by hash_find(), and stores the result for ELEMS[i] in
+   FOUND[i].  Like hash_insert_batch(), this overlaps the cache
+   misses of different lookups. */
+void
+hash_find_batch (struct hash *h, struct hash_elem **elems, size_t cnt,
+                 struct hash_elem **found)
+{
+  ASSERT (found != NULL);
+
+  run_batch (h, elems, cnt, found, false);
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -144,12 +301,12 @@ hash_find (struct hash *h, struct hash_elem *e)
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e)
 {
-  struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+  unsigned hash = h->hash (e, h->aux);
+  struct list *bucket;
+  struct hash_elem *found = lookup (h, e, hash, &bucket);
   if (found != NULL) 
-    {
-      remove_elem (h, found);
-      rehash (h); 
-    }
+    remove_elem (h, bucket, found);
+  rehash (h, true);
   return found;
 }
 
@@ -166,9 +323,10 @@ hash_apply (struct hash *h, hash_action_func *action)
   
   ASSERT (action != NULL);
 
+  finish_rehash (h);
   for (i = 0; i < h->bucket_cnt; i++) 
     {
-      struct list *bucket = &h->buckets[i];
+      struct list *bucket = init_bucket (&h->buckets[i]);
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -179,6 +337,108 @@ hash_apply (struct hash *h, hash_action_func *action)
     }
 }
 
+/* A range of buckets for one hash_apply_parallel() worker. */
+struct apply_range
+  {
+    struct hash *hash;          /* The hash table. */
+    hash_action_func *action;   /* Action to apply. */
+    size_t start, end;          /* Bucket indexes, end exclusive. */
+  };
+
+/* Calls RANGE_'s action for each element in its buckets.  Has
+   the signature of a thread function. */
+static void *
+apply_range (void *range_)
+{
+  struct apply_range *range = range_;
+  struct hash *h = range->hash;
+  size_t i;
+
+  for (i = range->start; i < range->end; i++) 
+    {
+      struct list *bucket = init_bucket (&h->buckets[i]);
+      struct list_elem *elem, *next;
+
+      for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
+        {
+          next = list_next (elem);
+          range->action (list_elem_to_hash_elem (elem), h->aux);
+        }
+    }
+  return NULL;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order, like hash_apply(), but splits the buckets into up to
+   THREAD_CNT ranges of about equal size and works on them in
+   parallel, one thread per range, with the calling thread
+   taking the last one.  Returns once every element has been
+   visited.
+
+   ACTION is called on different elements from different threads
+   at the same time, so it must not touch state shared between
+   elements without synchronizing; an action that only changes
+   the element it is given, as hash_square() and hash_triple()
+   do, is fine.  The same restrictions on modifying H apply as
+   for hash_apply().  Small tables use fewer threads than
+   THREAD_CNT, or just the caller's.  If a thread can't be
+   created, the caller handles its range itself. */
+void
+hash_apply_parallel (struct hash *h, hash_action_func *action,
+                     size_t thread_cnt)
+{
+  struct apply_range *ranges;
+  pthread_t *threads;
+  bool *started;
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  finish_rehash (h);
+  if (thread_cnt > h->elem_cnt / MIN_ELEMS_PER_THREAD)
+    thread_cnt = h->elem_cnt / MIN_ELEMS_PER_THREAD;
+  if (thread_cnt > h->bucket_cnt)
+    thread_cnt = h->bucket_cnt;
+  if (thread_cnt <= 1)
+    {
+      hash_apply (h, action);
+      return;
+    }
+
+  ranges = malloc (sizeof *ranges * thread_cnt);
+  threads = malloc (sizeof *threads * thread_cnt);
+  started = malloc (sizeof *started * thread_cnt);
+  if (ranges == NULL || threads == NULL || started == NULL)
+    {
+      free (ranges);
+      free (threads);
+      free (started);
+      hash_apply (h, action);
+      return;
+    }
+
+  for (i = 0; i < thread_cnt; i++)
+    {
+      ranges[i].hash = h;
+      ranges[i].action = action;
+      ranges[i].start = h->bucket_cnt * i / thread_cnt;
+      ranges[i].end = h->bucket_cnt * (i + 1) / thread_cnt;
+      started[i] = (i < thread_cnt - 1
+                    && pthread_create (&threads[i], NULL, apply_range,
+                                       &ranges[i]) == 0);
+    }
+  for (i = 0; i < thread_cnt; i++)
+    if (!started[i])
+      apply_range (&ranges[i]);
+  for (i = 0; i < thread_cnt; i++)
+    if (started[i])
+      pthread_join (threads[i], NULL);
+
+  free (ranges);
+  free (threads);
+  free (started);
+}
+
 /* Initializes I for iterating hash table H.
 
    Iteration idiom:
@@ -195,15 +455,18 @@ hash_apply (struct hash *h, hash_action_func *action)
    Modifying hash table H during iteration, using any of the
    functions hash_clear(), hash_destroy(), hash_insert(),
    hash_replace(), or hash_delete(), invalidates all
-   iterators. */
+   iterators.  So does hash_find() on a table that is being
+   resized incrementally; hash_first() completes any such resize
+   before iteration starts. */
 void
 hash_first (struct hash_iterator *i, struct hash *h) 
 {
   ASSERT (i != NULL);
   ASSERT (h != NULL);
 
+  finish_rehash (h);
   i->hash = h;
-  i->bucket = i->hash->buckets;
+  i->bucket = init_bucket (i->hash->buckets);
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
 
@@ -228,6 +491,7 @@ hash_next (struct hash_iterator *i)
           i->elem = NULL;
           break;
         }
+      init_bucket (i->bucket);
       i->elem = list_elem_to_hash_elem (list_begin (i->bucket));
     }
   
@@ -314,30 +578,285 @@ hash_int_2 (int i)
   return h;
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Constants for the word-at-a-time hashes below: odd 64-bit
+   values with well-mixed bits, as used by wyhash. */
+#define WORD_HASH_P0 0xa0761d6478bd642full
+#define WORD_HASH_P1 0xe7037ed1a0b428dbull
+#define WORD_HASH_P2 0x8ebc6af09c88c6e3ull
+
+/* Returns the 128-bit product of A and B, folded to 64 bits by
+   XORing its halves together. */
+static inline uint64_t
+mum (uint64_t a, uint64_t b)
+{
+  unsigned __int128 r = (unsigned __int128) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+/* Returns the 8 bytes at P, which need not be aligned. */
+static inline uint64_t
+read_word (const unsigned char *p)
+{
+  uint64_t w;
+  memcpy (&w, p, sizeof w);
+  return w;
+}
+
+/* Returns the 4 bytes at P, which need not be aligned. */
+static inline uint64_t
+read_half (const unsigned char *p)
+{
+  uint32_t w;
+  memcpy (&w, p, sizeof w);
+  return w;
+}
+
+/* Returns a hash of the SIZE bytes in BUF.
+
+   Unlike hash_bytes(), which feeds in one byte per step, this
+   mixes in 8 bytes per step with a single wide multiplication,
+   in the style of wyhash, so it is several times faster on all
+   but the shortest buffers.  Its values differ from
+   hash_bytes()'s. */
+unsigned
+hash_bytes_word (const void *buf_, size_t size)
+{
+  const unsigned char *buf = buf_;
+  uint64_t hash = WORD_HASH_P0 ^ size;
+  uint64_t tail;
+
+  ASSERT (buf != NULL);
+
+  /* Mix in all but the last 1 to 8 bytes, a word at a time. */
+  for (; size > 8; buf += 8, size -= 8)
+    hash = mum (hash ^ read_word (buf), WORD_HASH_P1);
+
+  /* Gather the rest into one word without a byte loop.  Reads
+     may overlap, but never go outside the buffer. */
+  if (size == 8)
+    tail = read_word (buf);
+  else if (size >= 4)
+    tail = (read_half (buf) << 32) | read_half (buf + size - 4);
+  else if (size > 0)
+    tail = ((uint64_t) buf[0] << 16) | ((uint64_t) buf[size / 2] << 8)
+           | buf[size - 1];
+  else
+    tail = 0;
+  hash = mum (hash ^ tail, WORD_HASH_P1);
+  hash = mum (hash, WORD_HASH_P2);
+
+  return (unsigned) (hash ^ (hash >> 32));
+}
+
+/* Returns a hash of string S, computed the same way as
+   hash_bytes_word() over its characters. */
+unsigned
+hash_string_word (const char *s) 
+{
+  ASSERT (s != NULL);
+
+  return hash_bytes_word (s, strlen (s));
+}
+
+/* Returns a hash of integer I using a single multiplication.
+   The product's upper half, which every bit of I feeds into,
+   becomes the hash, so its low bits are fit for indexing
+   buckets. */
+unsigned
+hash_int_mul (int i) 
+{
+  return (unsigned) (((uint64_t) (unsigned) i * WORD_HASH_P0) >> 32);
+}
+
+/* Returns the bucket in H that an element whose hash value is
+   HASH belongs in. */
 static struct list *
-find_bucket (struct hash *h, struct hash_elem *e) 
+find_bucket (struct hash *h, unsigned hash) 
+{
+  size_t bucket_idx = hash & (h->bucket_cnt - 1);
+  return init_bucket (&h->buckets[bucket_idx]);
+}
+
+/* Bucket arrays are allocated zero-filled and each bucket is
+   only made into an empty list when it is first used, so that
+   starting a resize doesn't have to touch the whole new array.
+   Returns BUCKET, after initializing it if necessary. */
+static inline struct list *
+init_bucket (struct list *bucket)
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  if (bucket->head.next == NULL)
+    list_init (bucket);
+  return bucket;
 }
 
-/* Searches BUCKET in H for a hash element equal to E.  Returns
-   it if found or a null pointer otherwise. */
+/* Returns true if A and B are equal according to H's equality
+   function, or, if it has none, according to two calls to its
+   LESS function. */
+static inline bool
+elems_equal (struct hash *h, struct hash_elem *a, struct hash_elem *b)
+{
+  if (h->equal != NULL)
+    return h->equal (a, b, h->aux);
+  return !h->less (a, b, h->aux) && !h->less (b, a, h->aux);
+}
+
+/* Searches BUCKET in H for a hash element equal to E, whose hash
+   value is HASH.  Returns it if found or a null pointer
+   otherwise.  Elements whose cached hash differs from HASH can't
+   be equal to E, so they are skipped without calling LESS. */
 static struct hash_elem *
-find_elem (struct hash *h, struct list *bucket, struct hash_elem *e) 
+find_elem (struct hash *h, struct list *bucket, struct hash_elem *e,
+           unsigned hash) 
 {
   struct list_elem *i;
 
   for (i = list_begin (bucket); i != list_end (bucket); i = list_next (i)) 
     {
       struct hash_elem *hi = list_elem_to_hash_elem (i);
-      if (!h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
+      if (hi->hash == hash && elems_equal (h, hi, e))
         return hi; 
     }
   return NULL;
 }
 
+/* Searches H for a hash element equal to E, whose hash value is
+   HASH, and returns it if found or a null pointer otherwise.
+   While H is being resized, E may still be in the old bucket
+   array, unless its bucket there has already been migrated.  If
+   BUCKETP is non-null, the bucket that was searched last, which
+   holds the element if one was found, is stored in *BUCKETP. */
+static struct hash_elem *
+lookup (struct hash *h, struct hash_elem *e, unsigned hash,
+        struct list **bucketp)
+{
+  struct list *bucket = find_bucket (h, hash);
+  struct hash_elem *found = find_elem (h, bucket, e, hash);
+
+  if (found == NULL && h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        {
+          bucket = init_bucket (&h->old_buckets[old_idx]);
+          found = find_elem (h, bucket, e, hash);
+        }
+    }
+  if (bucketp != NULL)
+    *bucketp = bucket;
+  return found;
+}
+
+/* Inserts NEW, whose hash value is HASH, into H, as
+   hash_insert() does. */
+static struct hash_elem *
+insert_hashed (struct hash *h, struct hash_elem *new, unsigned hash)
+{
+  struct hash_elem *old = lookup (h, new, hash, NULL);
+
+  if (old == NULL) 
+    insert_elem (h, find_bucket (h, hash), new, hash);
+
+  rehash (h, false);
+
+  return old; 
+}
+
+/* Finds an element equal to E, whose hash value is HASH, in H,
+   as hash_find() does. */
+static struct hash_elem *
+find_hashed (struct hash *h, struct hash_elem *e, unsigned hash)
+{
+  if (h->old_buckets != NULL)
+    rehash_step (h, REHASH_STEP);
+  return lookup (h, e, hash, NULL);
+}
+
+/* Returns the number of elements in group G of CNT elements
+   split into groups of BATCH_SIZE. */
+static inline size_t
+batch_len (size_t cnt, size_t g)
+{
+  size_t left = cnt - g * BATCH_SIZE;
+  return left < BATCH_SIZE ? left : BATCH_SIZE;
+}
+
+/* Computes the hash values of the CNT elements of ELEMS into
+   HASHES and starts loading their buckets in H. */
+static void
+prefetch_buckets (struct hash *h, struct hash_elem **elems, size_t cnt,
+                  unsigned hashes[])
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      hashes[i] = h->hash (elems[i], h->aux);
+      __builtin_prefetch (&h->buckets[hashes[i] & mask]);
+    }
+}
+
+/* Starts loading the first element in each of the buckets of H
+   for the CNT hash values in HASHES, whose buckets should already
+   be in the cache. */
+static void
+prefetch_heads (struct hash *h, const unsigned hashes[], size_t cnt)
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    __builtin_prefetch (h->buckets[hashes[i] & mask].head.next);
+}
+
+/* Inserts, if INSERT is true, or looks up the CNT elements of
+   ELEMS in H, in order, storing the result for ELEMS[i] in
+   RESULTS[i] if RESULTS is non-null.
+
+   The elements go through three stages, a group of BATCH_SIZE
+   at a time: hashing them and prefetching their buckets, then
+   prefetching the first element in each bucket, and then the
+   operations themselves.  Each stage works on a different group,
+   so the loads that one stage starts have a group's worth of
+   other work to hide behind before the next stage needs them.
+   Prefetches are only hints, so it doesn't matter that
+   insertions, and any resizing they cause, change H between the
+   stages. */
+static void
+run_batch (struct hash *h, struct hash_elem **elems, size_t cnt,
+           struct hash_elem **results, bool insert)
+{
+  unsigned hashes[3][BATCH_SIZE];
+  size_t group_cnt = (cnt + BATCH_SIZE - 1) / BATCH_SIZE;
+  size_t g;
+
+  for (g = 0; g < group_cnt + 2; g++)
+    {
+      if (g < group_cnt)
+        prefetch_buckets (h, elems + g * BATCH_SIZE,
+                          batch_len (cnt, g), hashes[g % 3]);
+      if (g >= 1 && g - 1 < group_cnt)
+        prefetch_heads (h, hashes[(g - 1) % 3], batch_len (cnt, g - 1));
+      if (g >= 2)
+        {
+          size_t first = (g - 2) * BATCH_SIZE;
+          size_t n = batch_len (cnt, g - 2);
+          const unsigned *group = hashes[(g - 2) % 3];
+          size_t i;
+
+          for (i = 0; i < n; i++)
+            {
+              struct hash_elem *e = elems[first + i];
+              struct hash_elem *r = (insert
+                                     ? insert_hashed (h, e, group[i])
+                                     : find_hashed (h, e, group[i]));
+              if (results != NULL)
+                results[first + i] = r;
+            }
+        }
+    }
+}
+
 /* Returns X with its lowest-order bit set to 1 turned off. */
 static inline size_t
 turn_off_least_1bit (size_t x) 
@@ -352,103 +871,173 @@ is_power_of_2 (size_t x)
   return x != 0 && turn_off_least_1bit (x) == 0;
 }
 
-/* Element per bucket ratios. */
-#define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
-#define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
-#define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
+/* Returns the number of buckets H should have to hold ELEM_CNT
+   elements without going over its maximum load: the smallest
+   power of 2, no less than MIN_BUCKET_CNT, that is enough. */
+static size_t
+bucket_cnt_for (const struct hash *h, size_t elem_cnt)
+{
+  size_t bucket_cnt = MIN_BUCKET_CNT;
+
+  while (elem_cnt * 100 >= bucket_cnt * h->max_load)
+    bucket_cnt *= 2;
+  return bucket_cnt;
+}
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Changes the number of buckets in hash table H to match its
+   load factors.  H grows when it is max_load percent full or
+   more and, if MAY_SHRINK is true, shrinks when it is less than
+   min_load percent full.  Because max_load is more than twice
+   min_load, the load right after a resize is well inside the
+   two, and the table does not flip back and forth.  Only
+   deletions shrink H, so that buckets reserved for a bulk load
+   are kept while it fills up.
+
+   This function can fail because of an out-of-memory condition,
+   but that'll just make hash accesses less efficient; we can
+   still continue.
+
+   If H is being resized incrementally, this only continues the
+   resize in progress, if any, or otherwise starts a new one. */
 static void
-rehash (struct hash *h) 
+rehash (struct hash *h, bool may_shrink) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
-  size_t i;
+  size_t new_bucket_cnt;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  /* Finish one resize before starting the next. */
+  if (h->old_buckets != NULL)
+    {
+      rehash_step (h, REHASH_STEP);
+      return;
+    }
 
-  /* Calculate the number of buckets to use now.
-     We want one bucket for about every BEST_ELEMS_PER_BUCKET.
-     We must have at least four buckets, and the number of
-     buckets must be a power of 2. */
-  new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
-  if (new_bucket_cnt < 4)
-    new_bucket_cnt = 4;
-  while (!is_power_of_2 (new_bucket_cnt))
-    new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
+  /* Calculate the number of buckets to use now.  The number of
+     buckets must stay a power of 2 and at least MIN_BUCKET_CNT. */
+  new_bucket_cnt = h->bucket_cnt;
+  while (h->elem_cnt * 100 >= new_bucket_cnt * h->max_load)
+    new_bucket_cnt *= 2;
+  if (may_shrink)
+    while (new_bucket_cnt > MIN_BUCKET_CNT
+           && h->elem_cnt * 100 < new_bucket_cnt * h->min_load)
+      new_bucket_cnt /= 2;
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
-    return;
+  if (new_bucket_cnt != h->bucket_cnt)
+    resize (h, new_bucket_cnt);
+}
 
-  /* Allocate new buckets and initialize them as empty. */
-  new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt);
+/* Starts moving the elements of H into a new array of
+   NEW_BUCKET_CNT buckets, and, unless H is resized incrementally,
+   finishes doing so.  H must not be in the middle of a resize.
+   Returns false if memory allocation failed, in which case H is
+   unchanged. */
+static bool
+resize (struct hash *h, size_t new_bucket_cnt)
+{
+  struct list *new_buckets;
+
+  ASSERT (h->old_buckets == NULL);
+  ASSERT (is_power_of_2 (new_bucket_cnt));
+
+  /* Allocate new buckets, to be initialized as they are used. */
+  new_buckets = calloc (new_bucket_cnt, sizeof *new_buckets);
   if (new_buckets == NULL) 
     {
       /* Allocation failed.  This means that use of the hash table will
          be less efficient.  However, it is still usable, so
          there's no reason for it to be an error. */
-      return;
+      return false;
     }
-  for (i = 0; i < new_bucket_cnt; i++) 
-    list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets around
+     until their elements have been moved. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->migrate_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
+  if (h->incremental)
+    rehash_step (h, REHASH_STEP);
+  else
+    finish_rehash (h);
+  return true;
+}
+
+/* Moves the elements of up to CNT more old buckets of H into the
+   appropriate new buckets, using their cached hash values rather
+   than calling the hash function, and frees the old bucket array
+   once it is empty.  H must be in the middle of a resize. */
+static void
+rehash_step (struct hash *h, size_t cnt)
+{
+  ASSERT (h->old_buckets != NULL);
+
+  for (; cnt > 0 && h->migrate_idx < h->old_bucket_cnt; cnt--) 
     {
       struct list *old_bucket;
-      struct list_elem *elem, *next;
 
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
+      old_bucket = init_bucket (&h->old_buckets[h->migrate_idx++]);
+      while (!list_empty (old_bucket)) 
         {
+          struct list_elem *elem = list_pop_front (old_bucket);
           struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
+            = find_bucket (h, list_elem_to_hash_elem (elem)->hash);
           list_push_front (new_bucket, elem);
         }
     }
 
-  free (old_buckets);
+  if (h->migrate_idx >= h->old_bucket_cnt)
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+      h->migrate_idx = 0;
+    }
 }
 
-/* Inserts E into BUCKET (in hash table H). */
+/* Completes any resize of H that is in progress. */
 static void
-insert_elem (struct hash *h, struct list *bucket, struct hash_elem *e) 
+finish_rehash (struct hash *h)
 {
+  if (h->old_buckets != NULL)
+    rehash_step (h, h->old_bucket_cnt);
+}
+
+/* Inserts E, whose hash value is HASH, into BUCKET (in hash
+   table H). */
+static void
+insert_elem (struct hash *h, struct list *bucket, struct hash_elem *e,
+             unsigned hash) 
+{
+  e->hash = hash;
   h->elem_cnt++;
   list_push_front (bucket, &e->list_elem);
 }
 
-/* Removes E from hash table H. */
+/* Removes E from BUCKET (in hash table H). */
 static void
-remove_elem (struct hash *h, struct hash_elem *e) 
+remove_elem (struct hash *h, struct list *bucket, struct hash_elem *e) 
 {
   h->elem_cnt--;
-  list_remove (&e->list_elem);
+  list_remove (bucket, &e->list_elem);
 }
 
 
 /*Additional implement for processing*/
 
+/* Each table made by create_hash() allocates its elements from a
+   pool of its own, which it keeps as its auxiliary data, so that
+   delete_hash() can release them all at once.  new_elem()
+   returns a null pointer if memory allocation fails. */
 struct hash_elem *
-new_elem (int value)
+new_elem (struct hash *h, int value)
 {
-  struct hash_elem *e = (struct hash_elem *) calloc (1, sizeof (struct hash_elem));
-  e->data = value;
+  struct hash_elem *e = pool_alloc (h->aux);
+  if (e != NULL)
+    e->data = value;
 
   return e;
 }
@@ -459,6 +1048,12 @@ hash_less (const struct hash_elem *a, const struct hash_elem *b, void *aux)
   return a->data < b->data;
 }
 
+bool
+hash_equal (const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+  return a->data == b->data;
+}
+
 unsigned
 hash_func (const struct hash_elem *e, void *aux)
 {
@@ -471,22 +1066,26 @@ hash_print (struct hash_elem *e, void *aux)
   printf("%d ", e->data);
 }
 
+/* hash_square() and hash_triple() change the key of E, so they
+   refresh its cached hash value to match. */
 void
 hash_square (struct hash_elem *e, void *aux)
 {
   e->data = e->data * e->data;
+  e->hash = hash_func (e, aux);
 }
 
 void
 hash_triple (struct hash_elem *e, void *aux)
 {
   e->data = e->data * e->data * e->data;
+  e->hash = hash_func (e, aux);
 }
 
 void
 hash_destruct (struct hash_elem *e, void *aux)
 {
-  free(e);
+  pool_free (aux, e);
   return;
 }
 
@@ -498,7 +1097,9 @@ create_hash (struct hash **Hash, char *hash_name)
   ASSERT (Hash[index] == NULL);
 
   struct hash *new_hash = (struct hash *) calloc (1, sizeof(struct hash));
-  hash_init (new_hash, hash_func, hash_less, NULL);
+  struct pool *pool = (struct pool *) malloc (sizeof (struct pool));
+  pool_init (pool, sizeof (struct hash_elem));
+  hash_init_equal (new_hash, hash_func, hash_less, hash_equal, pool);
 
   Hash[index] = new_hash;
 
@@ -512,7 +1113,28 @@ delete_hash (struct hash **Hash, char *hash_name)
 
   ASSERT (Hash[index] != NULL);
 
-  hash_destroy (Hash[index], hash_destruct);
+  /* Releasing the pool frees every element, without a
+     destructor call per element. */
+  hash_destroy (Hash[index], NULL);
+  pool_destroy (Hash[index]->aux);
+  free (Hash[index]->aux);
+  free (Hash[index]);
+  Hash[index] = NULL;
+
+  return;
+}
+
+void
+clear_hash (struct hash **Hash, char *hash_name)
+{
+  int index = atoi (hash_name + 4);
+
+  ASSERT (Hash[index] != NULL);
+
+  /* As in delete_hash(), resetting the pool frees every element
+     at once. */
+  hash_clear (Hash[index], NULL);
+  pool_destroy (Hash[index]->aux);
 
   return;
 }
@@ -540,10 +1162,14 @@ apply_hash (struct hash **Hash, char *hash_name, int command)
 
   ASSERT (Hash[index] != NULL);
 
+  /* Squaring or tripling an element touches nothing else, so
+     it can be done on all the processors at once. */
+  size_t thread_cnt = sysconf (_SC_NPROCESSORS_ONLN);
+
   if (command == 0)
-    hash_apply (Hash[index], hash_square);
+    hash_apply_parallel (Hash[index], hash_square, thread_cnt);
   else
-    hash_apply (Hash[index], hash_triple);
+    hash_apply_parallel (Hash[index], hash_triple, thread_cnt);
 
   return;
 }
\ No newline at end of file
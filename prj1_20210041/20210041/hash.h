@@ -26,6 +26,7 @@
 struct hash_elem 
   {
     struct list_elem list_elem;
+    unsigned hash;              /* Hash value, cached by the table. */
     int data;
   };
 
@@ -40,6 +41,12 @@ typedef bool hash_less_func (const struct hash_elem *a,
                              const struct hash_elem *b,
                              void *aux);
 
+/* Returns true if hash elements A and B are equal, given
+   auxiliary data AUX, or false otherwise. */
+typedef bool hash_equal_func (const struct hash_elem *a,
+                              const struct hash_elem *b,
+                              void *aux);
+
 /* Performs some operation on hash element E, given auxiliary
    data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
@@ -52,7 +59,14 @@ struct hash
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
+    hash_equal_func *equal;     /* Equality function, or null. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
+    unsigned min_load;          /* Shrink below this many elems/100 buckets. */
+    unsigned max_load;          /* Grow at this many elems/100 buckets. */
+    struct list *old_buckets;   /* Buckets still being migrated, or null. */
+    size_t old_bucket_cnt;      /* Number of buckets in `old_buckets'. */
+    size_t migrate_idx;         /* Next old bucket to migrate. */
+    bool incremental;           /* Resize a few buckets at a time? */
   };
 
 /* A hash table iterator. */
@@ -65,17 +79,34 @@ struct hash_iterator
 
 /* Basic life cycle. */
 bool hash_init (struct hash *, hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_equal (struct hash *, hash_hash_func *, hash_less_func *,
+                      hash_equal_func *, void *aux);
+bool hash_init_with_capacity (struct hash *, size_t capacity,
+                              hash_hash_func *, hash_less_func *,
+                              hash_equal_func *, void *aux);
 void hash_clear (struct hash *, hash_action_func *);
 void hash_destroy (struct hash *, hash_action_func *);
 
+/* Resizing. */
+void hash_set_load_factors (struct hash *, unsigned min_load,
+                            unsigned max_load);
+bool hash_reserve (struct hash *, size_t capacity);
+void hash_set_incremental (struct hash *, bool);
+
 /* Search, insertion, deletion. */
 struct hash_elem *hash_insert (struct hash *, struct hash_elem *);
 struct hash_elem *hash_replace (struct hash *, struct hash_elem *);
 struct hash_elem *hash_find (struct hash *, struct hash_elem *);
 struct hash_elem *hash_delete (struct hash *, struct hash_elem *);
+void hash_insert_batch (struct hash *, struct hash_elem **, size_t cnt,
+                        struct hash_elem **olds);
+void hash_find_batch (struct hash *, struct hash_elem **, size_t cnt,
+                      struct hash_elem **found);
 
 /* Iteration. */
 void hash_apply (struct hash *, hash_action_func *);
+void hash_apply_parallel (struct hash *, hash_action_func *,
+                          size_t thread_cnt);
 void hash_first (struct hash_iterator *, struct hash *);
 struct hash_elem *hash_next (struct hash_iterator *);
 struct hash_elem *hash_cur (struct hash_iterator *);
@@ -88,12 +119,20 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_int_2 (int);
+unsigned hash_bytes_word (const void *, size_t);
+unsigned hash_string_word (const char *);
+unsigned hash_int_mul (int);
+
+/* Number of hash table slots in main(), hash0 through hash19. */
+#define HASH_SLOT_CNT 20
 
 void create_hash (struct hash **, char *);
 void delete_hash (struct hash **, char *);
+void clear_hash (struct hash **, char *);
 void dumpdata_hash (struct hash **, char *);
 
-struct hash_elem *new_elem (int);
+struct hash_elem *new_elem (struct hash *, int);
 void hash_destruct (struct hash_elem *, void *);
 
 void apply_hash (struct hash **, char *, int);
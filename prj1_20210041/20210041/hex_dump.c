@@ -1,15 +1,78 @@
 #include <stdio.h> 
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
 #include "hex_dump.h"
 #include "round.h"
 
-/* Dumps the SIZE bytes in BUF to the console as hex bytes
-   arranged 16 per line.  Numeric offsets are also included,
-   starting at OFS for the first byte in BUF.  If ASCII is true
-   then the corresponding ASCII characters are also rendered
-   alongside. */   
+/* Size of the buffer that output is formatted into before it is
+   written out. */
+#define DUMP_BUF_SIZE 16384
+
+/* Longest line hex_dump_to() can produce, with room to spare. */
+#define DUMP_LINE_MAX 128
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Formatted output on its way to a stream or a file
+   descriptor. */
+struct dump_out
+  {
+    FILE *file;                 /* Stream to write to, or null. */
+    int fd;                     /* Otherwise, file descriptor. */
+    size_t len;                 /* Bytes used in buf. */
+    char buf[DUMP_BUF_SIZE];    /* Pending output. */
+  };
+
+/* Writes the LEN bytes in BUF to FILE, if it is non-null, or to
+   file descriptor FD otherwise.  Writes to FD are retried after
+   interruptions and short writes until everything is written or
+   an error occurs. */
 void
-hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii)
+hex_dump_write (FILE *file, int fd, const void *buf_, size_t len)
+{
+  const char *buf = buf_;
+
+  if (file != NULL)
+    {
+      fwrite (buf, 1, len, file);
+      return;
+    }
+  while (len > 0)
+    {
+      ssize_t n = write (fd, buf, len);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return;
+        }
+      buf += n;
+      len -= n;
+    }
+}
+
+/* Writes all of OUT's pending output and empties it. */
+static void
+dump_flush (struct dump_out *out)
+{
+  hex_dump_write (out->file, out->fd, out->buf, out->len);
+  out->len = 0;
+}
+
+/* Appends CNT copies of character C to OUT. */
+static inline void
+dump_fill (struct dump_out *out, char c, size_t cnt)
+{
+  while (cnt-- > 0)
+    out->buf[out->len++] = c;
+}
+
+/* Dumps the SIZE bytes in BUF to OUT, in the format described at
+   hex_dump(). */
+static void
+hex_dump_to (struct dump_out *out, uintptr_t ofs, const void *buf__,
+             size_t size, bool ascii)
 {
   const uint8_t *buf = buf__;
   const size_t per_line = 16; /* Maximum bytes per line. */
@@ -18,7 +81,12 @@ hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii)
     {
       size_t start, end, n;
       size_t i;
-      
+      uintmax_t line_ofs;
+      int digits;
+
+      if (out->len + DUMP_LINE_MAX > DUMP_BUF_SIZE)
+        dump_flush (out);
+
       /* Number of bytes on this line. */
       start = ofs % per_line;
       end = per_line;
@@ -26,31 +94,72 @@ hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii)
         end = start + size;
       n = end - start;
 
+      /* Print the offset, zero-padded to at least 8 hex digits,
+         like "%08jx". */
+      line_ofs = ROUND_DOWN (ofs, per_line);
+      for (digits = 8; digits < (int) sizeof line_ofs * 2
+                       && line_ofs >> (digits * 4) != 0; digits++)
+        continue;
+      while (digits-- > 0)
+        out->buf[out->len++] = hex_digits[(line_ofs >> (digits * 4)) & 0xf];
+      dump_fill (out, ' ', 2);
+
       /* Print line. */
-      printf ("%08jx  ", (uintmax_t) ROUND_DOWN (ofs, per_line));
-      for (i = 0; i < start; i++)
-        printf ("   ");
-      for (; i < end; i++) 
-        printf ("%02hhx%c",
-                buf[i - start], i == per_line / 2 - 1? '-' : ' ');
+      dump_fill (out, ' ', 3 * start);
+      for (i = start; i < end; i++) 
+        {
+          uint8_t byte = buf[i - start];
+          out->buf[out->len++] = hex_digits[byte >> 4];
+          out->buf[out->len++] = hex_digits[byte & 0xf];
+          out->buf[out->len++] = i == per_line / 2 - 1 ? '-' : ' ';
+        }
       if (ascii) 
         {
-          for (; i < per_line; i++)
-            printf ("   ");
-          printf ("|");
-          for (i = 0; i < start; i++)
-            printf (" ");
-          for (; i < end; i++)
-            printf ("%c",
-                    isprint (buf[i - start]) ? buf[i - start] : '.');
-          for (; i < per_line; i++)
-            printf (" ");
-          printf ("|");
+          dump_fill (out, ' ', 3 * (per_line - end));
+          out->buf[out->len++] = '|';
+          dump_fill (out, ' ', start);
+          for (i = start; i < end; i++)
+            out->buf[out->len++] = (isprint (buf[i - start])
+                                    ? buf[i - start] : '.');
+          dump_fill (out, ' ', per_line - end);
+          out->buf[out->len++] = '|';
         }
-      printf ("\n");
+      out->buf[out->len++] = '\n';
 
       ofs += n;
       buf += n;
       size -= n;
     }
 }
+
+/* Dumps the SIZE bytes in BUF to the console as hex bytes
+   arranged 16 per line.  Numeric offsets are also included,
+   starting at OFS for the first byte in BUF.  If ASCII is true
+   then the corresponding ASCII characters are also rendered
+   alongside.  Lines are formatted into a large buffer and
+   written out a buffer at a time. */   
+void
+hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii)
+{
+  struct dump_out out;
+
+  out.file = stdout;
+  out.len = 0;
+  hex_dump_to (&out, ofs, buf__, size, ascii);
+  dump_flush (&out);
+}
+
+/* Like hex_dump(), but writes to file descriptor FD instead of
+   the console. */
+void
+hex_dump_fd (int fd, uintptr_t ofs, const void *buf__, size_t size,
+             bool ascii)
+{
+  struct dump_out out;
+
+  out.file = NULL;
+  out.fd = fd;
+  out.len = 0;
+  hex_dump_to (&out, ofs, buf__, size, ascii);
+  dump_flush (&out);
+}
@@ -2,8 +2,13 @@
 #define __HEX_DUMP_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdint.h>
 
 void hex_dump (uintptr_t ofs, const void *buf__, size_t size, bool ascii);
+void hex_dump_fd (int fd, uintptr_t ofs, const void *buf__, size_t size,
+                  bool ascii);
+void hex_dump_write (FILE *file, int fd, const void *buf, size_t len);
 
 #endif /* hex_dump.h */
@@ -1,8 +1,12 @@
 #include "list.h"
+#include "pool.h"
+#include "skiplist.h"
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 /*For rand() when shuffle list*/
 #include <stdlib.h>
+#include <string.h>
 #define ASSERT(CONDITION) assert(CONDITION)	
 
 /* Our doubly linked lists have two header elements: the "head"
@@ -37,6 +41,8 @@
 
 static bool is_sorted (struct list_elem *a, struct list_elem *b,
                        list_less_func *less, void *aux);
+static void splice_range (struct list_elem *before,
+                          struct list_elem *first, struct list_elem *last);
                        
 /* Returns true if ELEM is a head, false otherwise. */
 static inline bool
@@ -69,6 +75,7 @@ list_init (struct list *list)
   list->head.next = &list->tail;
   list->tail.prev = &list->head;
   list->tail.next = NULL;
+  list->elem_cnt = 0;
 }
 
 /* Returns the beginning of LIST.  */
@@ -166,12 +173,14 @@ list_tail (struct list *list)
   return &list->tail;
 }
 
-/* Inserts ELEM just before BEFORE, which may be either an
-   interior element or a tail.  The latter case is equivalent to
-   list_push_back(). */
+/* Inserts ELEM into LIST just before BEFORE, which may be either
+   an interior element or the tail of LIST.  The latter case is
+   equivalent to list_push_back(). */
 void
-list_insert (struct list_elem *before, struct list_elem *elem)
+list_insert (struct list *list, struct list_elem *before,
+             struct list_elem *elem)
 {
+  ASSERT (list != NULL);
   ASSERT (is_interior (before) || is_tail (before));
   ASSERT (elem != NULL);
 
@@ -179,14 +188,62 @@ list_insert (struct list_elem *before, struct list_elem *elem)
   elem->next = before;
   before->prev->next = elem;
   before->prev = elem;
+  list->elem_cnt++;
 }
 
-/* Removes elements FIRST though LAST (exclusive) from their
-   current list, then inserts them just before BEFORE, which may
-   be either an interior element or a tail. */
+/* Removes elements FIRST though LAST (exclusive) from list FROM,
+   then inserts them into LIST just before BEFORE, which may be
+   either an interior element or the tail of LIST.  FROM may be
+   LIST itself.
+
+   Moving elements within a list takes constant time, but moving
+   them from one list to another has to count them to keep both
+   lists' sizes right, which takes time linear in their number.
+   Use list_splice_cnt() instead if the count is known. */
 void
-list_splice (struct list_elem *before,
+list_splice (struct list *list, struct list_elem *before,
+             struct list *from,
              struct list_elem *first, struct list_elem *last)
+{
+  size_t cnt = 0;
+
+  if (list != from)
+    {
+      struct list_elem *e;
+
+      for (e = first; e != last; e = list_next (e))
+        cnt++;
+    }
+  list_splice_cnt (list, before, from, first, last, cnt);
+}
+
+/* Like list_splice(), but in constant time, given that the
+   range FIRST through LAST (exclusive) holds CNT elements.  CNT
+   is ignored if FROM is LIST. */
+void
+list_splice_cnt (struct list *list, struct list_elem *before,
+                 struct list *from,
+                 struct list_elem *first, struct list_elem *last,
+                 size_t cnt)
+{
+  ASSERT (list != NULL && from != NULL);
+
+  splice_range (before, first, last);
+  if (list != from)
+    {
+      ASSERT (from->elem_cnt >= cnt);
+      from->elem_cnt -= cnt;
+      list->elem_cnt += cnt;
+    }
+}
+
+/* Removes elements FIRST though LAST (exclusive) from their
+   current list, then inserts them just before BEFORE, which may
+   be either an interior element or a tail.  Leaves the lists'
+   element counts alone. */
+static void
+splice_range (struct list_elem *before,
+              struct list_elem *first, struct list_elem *last)
 {
   ASSERT (is_interior (before) || is_tail (before));
   if (first == last)
@@ -212,7 +269,7 @@ list_splice (struct list_elem *before,
 void
 list_push_front (struct list *list, struct list_elem *elem)
 {
-  list_insert (list_begin (list), elem);
+  list_insert (list, list_begin (list), elem);
 }
 
 /* Inserts ELEM at the end of LIST, so that it becomes the
@@ -220,11 +277,11 @@ list_push_front (struct list *list, struct list_elem *elem)
 void
 list_push_back (struct list *list, struct list_elem *elem)
 {
-  list_insert (list_end (list), elem);
+  list_insert (list, list_end (list), elem);
 }
 
-/* Removes ELEM from its list and returns the element that
-   followed it.  Undefined behavior if ELEM is not in a list.
+/* Removes ELEM from LIST and returns the element that followed
+   it.  Undefined behavior if ELEM is not in LIST.
 
    It's not safe to treat ELEM as an element in a list after
    removing it.  In particular, using list_next() or list_prev()
@@ -235,14 +292,15 @@ list_push_back (struct list *list, struct list_elem *elem)
    for (e = list_begin (&list); e != list_end (&list); e = list_next (e))
      {
        ...do something with e...
-       list_remove (e);
+       list_remove (&list, e);
      }
    ** DON'T DO THIS **
 
    Here is one correct way to iterate and remove elements from a
    list:
 
-   for (e = list_begin (&list); e != list_end (&list); e = list_remove (e))
+   for (e = list_begin (&list); e != list_end (&list);
+        e = list_remove (&list, e))
      {
        ...do something with e...
      }
@@ -258,11 +316,14 @@ list_push_back (struct list *list, struct list_elem *elem)
      }
 */
 struct list_elem *
-list_remove (struct list_elem *elem)
+list_remove (struct list *list, struct list_elem *elem)
 {
+  ASSERT (list != NULL);
   ASSERT (is_interior (elem));
+  ASSERT (list->elem_cnt > 0);
   elem->prev->next = elem->next;
   elem->next->prev = elem->prev;
+  list->elem_cnt--;
   return elem->next;
 }
 
@@ -272,7 +333,7 @@ struct list_elem *
 list_pop_front (struct list *list)
 {
   struct list_elem *front = list_front (list);
-  list_remove (front);
+  list_remove (list, front);
   return front;
 }
 
@@ -282,7 +343,7 @@ struct list_elem *
 list_pop_back (struct list *list)
 {
   struct list_elem *back = list_back (list);
-  list_remove (back);
+  list_remove (list, back);
   return back;
 }
 
@@ -305,16 +366,13 @@ list_back (struct list *list)
 }
 
 /* Returns the number of elements in LIST.
-   Runs in O(n) in the number of elements. */
+   Runs in O(1), since LIST keeps count as elements come and
+   go. */
 size_t
 list_size (struct list *list)
 {
-  struct list_elem *e;
-  size_t cnt = 0;
-
-  for (e = list_begin (list); e != list_end (list); e = list_next (e))
-    cnt++;
-  return cnt;
+  ASSERT (list != NULL);
+  return list->elem_cnt;
 }
 
 /* Returns true if LIST is empty, false otherwise. */
@@ -468,7 +526,7 @@ inplace_merge (struct list_elem *a0, struct list_elem *a1b0,
     else 
       {
         a1b0 = list_next (a1b0);
-        list_splice (a0, list_prev (a1b0), a1b0);
+        splice_range (a0, list_prev (a1b0), a1b0);
       }
 }
 
@@ -513,6 +571,419 @@ list_sort (struct list *list, list_less_func *less, void *aux)
   ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
 }
 
+/* Length of the runs that sort_array() sorts by insertion
+   before it starts merging. */
+#define ARRAY_SORT_RUN 16
+
+/* Merges the sorted ranges A[0...A_CNT) and B[0...B_CNT) into
+   OUT, according to LESS given auxiliary data AUX.  Equal
+   elements are taken from A first, which keeps the merge
+   stable. */
+static void
+merge_array (struct list_elem **a, size_t a_cnt,
+             struct list_elem **b, size_t b_cnt,
+             struct list_elem **out, list_less_func *less, void *aux)
+{
+  while (a_cnt > 0 && b_cnt > 0)
+    if (less (*b, *a, aux))
+      {
+        *out++ = *b++;
+        b_cnt--;
+      }
+    else
+      {
+        *out++ = *a++;
+        a_cnt--;
+      }
+  while (a_cnt-- > 0)
+    *out++ = *a++;
+  while (b_cnt-- > 0)
+    *out++ = *b++;
+}
+
+/* Sorts the CNT elements of ELEMS stably according to LESS given
+   auxiliary data AUX, using TMP, which has room for CNT
+   elements, as scratch space.  This is a bottom-up merge sort
+   over runs first sorted by insertion.  Adjacent runs that are
+   already in order are copied rather than merged, so sorted
+   input takes a single pass of comparisons. */
+static void
+sort_array (struct list_elem **elems, struct list_elem **tmp, size_t cnt,
+            list_less_func *less, void *aux)
+{
+  struct list_elem **src = elems, **dst = tmp;
+  size_t width, i, j;
+
+  for (i = 0; i < cnt; i += ARRAY_SORT_RUN)
+    {
+      size_t end = i + ARRAY_SORT_RUN < cnt ? i + ARRAY_SORT_RUN : cnt;
+
+      for (j = i + 1; j < end; j++)
+        {
+          struct list_elem *e = elems[j];
+          size_t k;
+
+          for (k = j; k > i && less (e, elems[k - 1], aux); k--)
+            elems[k] = elems[k - 1];
+          elems[k] = e;
+        }
+    }
+
+  for (width = ARRAY_SORT_RUN; width < cnt; width *= 2)
+    {
+      struct list_elem **t;
+
+      for (i = 0; i < cnt; i += 2 * width)
+        {
+          size_t mid = i + width < cnt ? i + width : cnt;
+          size_t end = mid + width < cnt ? mid + width : cnt;
+
+          if (mid == end || !less (src[mid], src[mid - 1], aux))
+            memcpy (dst + i, src + i, (end - i) * sizeof *src);
+          else
+            merge_array (src + i, mid - i, src + mid, end - mid, dst + i,
+                         less, aux);
+        }
+      t = src;
+      src = dst;
+      dst = t;
+    }
+
+  if (src != elems)
+    memcpy (elems, src, cnt * sizeof *elems);
+}
+
+/* Sorts LIST according to LESS given auxiliary data AUX, like
+   list_sort(), and just as stably, but by copying pointers to
+   its elements into an array, sorting the array, and then
+   relinking the list in one pass.  The sort works on contiguous
+   memory rather than chasing links between scattered elements,
+   which makes it much faster on long lists, at the cost of
+   O(n) extra space.  Falls back to list_sort() if that space
+   can't be allocated. */
+void
+list_sort_array (struct list *list, list_less_func *less, void *aux)
+{
+  size_t cnt = list_size (list);
+  struct list_elem **elems;
+  struct list_elem *e, *prev;
+  bool sorted;
+  size_t i;
+
+  ASSERT (list != NULL);
+  ASSERT (less != NULL);
+
+  if (cnt < 2)
+    return;
+  elems = malloc (2 * cnt * sizeof *elems);
+  if (elems == NULL)
+    {
+      list_sort (list, less, aux);
+      return;
+    }
+
+  /* Collect the elements, noticing on the way whether they are
+     already in order, in which case there is nothing to do. */
+  sorted = true;
+  for (e = list_begin (list), i = 0; e != list_end (list); e = list_next (e))
+    {
+      if (sorted && i > 0 && less (e, elems[i - 1], aux))
+        sorted = false;
+      elems[i++] = e;
+    }
+  if (sorted)
+    {
+      free (elems);
+      return;
+    }
+  sort_array (elems, elems + cnt, cnt, less, aux);
+
+  prev = list_head (list);
+  for (i = 0; i < cnt; i++)
+    {
+      prev->next = elems[i];
+      elems[i]->prev = prev;
+      prev = elems[i];
+    }
+  prev->next = list_tail (list);
+  list_tail (list)->prev = prev;
+
+  free (elems);
+  ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
+}
+
+/* An element to sort by key, with its key biased so that
+   unsigned order matches the signed order of the original. */
+struct keyed_elem
+  {
+    uint32_t key;
+    struct list_elem *elem;
+  };
+
+/* A key function and its auxiliary data, for key_less(). */
+struct key_aux
+  {
+    list_key_func *key;
+    void *aux;
+  };
+
+/* Compares A and B by the keys that the struct key_aux in AUX_
+   extracts, for falling back to list_sort(). */
+static bool
+key_less (const struct list_elem *a, const struct list_elem *b, void *aux_)
+{
+  struct key_aux *aux = aux_;
+  return aux->key (a, aux->aux) < aux->key (b, aux->aux);
+}
+
+/* Sorts LIST stably in increasing order of the integer key that
+   KEY returns for each element, given auxiliary data AUX.
+
+   KEY is called once per element.  The elements are sorted by an
+   LSD radix sort over the four bytes of their keys, with no
+   comparisons at all, so the sort runs in O(n) time; passes for
+   bytes that are the same in every key are skipped.  The list is
+   then relinked in one pass.  Needs O(n) extra space and falls
+   back to list_sort() if it can't be allocated. */
+void
+list_sort_by_key (struct list *list, list_key_func *key, void *aux)
+{
+  size_t cnt = list_size (list);
+  struct keyed_elem *src, *dst, *t;
+  size_t counts[4][256];
+  struct list_elem *e, *prev;
+  size_t i;
+  int pass;
+
+  ASSERT (list != NULL);
+  ASSERT (key != NULL);
+
+  if (cnt < 2)
+    return;
+  src = malloc (2 * cnt * sizeof *src);
+  if (src == NULL)
+    {
+      struct key_aux key_aux = {key, aux};
+      list_sort (list, key_less, &key_aux);
+      return;
+    }
+  dst = src + cnt;
+
+  /* Collect the keys and count how often each byte value occurs
+     at each position. */
+  memset (counts, 0, sizeof counts);
+  for (e = list_begin (list), i = 0; e != list_end (list); e = list_next (e))
+    {
+      uint32_t k = (uint32_t) key (e, aux) ^ 0x80000000u;
+
+      src[i].key = k;
+      src[i++].elem = e;
+      for (pass = 0; pass < 4; pass++)
+        counts[pass][(k >> (pass * 8)) & 0xff]++;
+    }
+
+  /* Distribute by each byte, least significant first.  Each pass
+     is stable, so the result is sorted by the whole key. */
+  for (pass = 0; pass < 4; pass++)
+    {
+      size_t *c = counts[pass];
+      size_t sum = 0;
+      int shift = pass * 8;
+
+      if (c[(src[0].key >> shift) & 0xff] == cnt)
+        continue;
+      for (i = 0; i < 256; i++)
+        {
+          size_t n = c[i];
+          c[i] = sum;
+          sum += n;
+        }
+      for (i = 0; i < cnt; i++)
+        dst[c[(src[i].key >> shift) & 0xff]++] = src[i];
+      t = src;
+      src = dst;
+      dst = t;
+    }
+
+  prev = list_head (list);
+  for (i = 0; i < cnt; i++)
+    {
+      prev->next = src[i].elem;
+      src[i].elem->prev = prev;
+      prev = src[i].elem;
+    }
+  prev->next = list_tail (list);
+  list_tail (list)->prev = prev;
+
+  free (src < dst ? src : dst);
+}
+
+/* Fewest elements per thread for which list_sort_parallel()
+   starts another thread. */
+#define MIN_SORT_ELEMS_PER_THREAD 16384
+
+/* Merges list B, which must be sorted according to LESS given
+   auxiliary data AUX, into list A, which must be sorted the same
+   way, leaving B empty.  Runs of B's elements are spliced in
+   between A's, and an element of B only goes ahead of an element
+   of A that it is less than, so the merge is stable if A's
+   elements came first. */
+static void
+merge_lists (struct list *a, struct list *b, list_less_func *less, void *aux)
+{
+  struct list_elem *ea = list_begin (a);
+
+  while (!list_empty (b) && ea != list_end (a))
+    {
+      struct list_elem *first = list_begin (b);
+
+      if (less (first, ea, aux))
+        {
+          struct list_elem *last = list_next (first);
+          size_t cnt = 1;
+
+          while (last != list_end (b) && less (last, ea, aux))
+            {
+              last = list_next (last);
+              cnt++;
+            }
+          list_splice_cnt (a, ea, b, first, last, cnt);
+        }
+      else
+        ea = list_next (ea);
+    }
+  if (!list_empty (b))
+    list_splice_cnt (a, list_end (a), b, list_begin (b), list_end (b),
+                     list_size (b));
+}
+
+/* Work for one list_sort_parallel() thread: sort A, or, if B is
+   non-null, merge B into A. */
+struct sort_job
+  {
+    struct list *a, *b;         /* Lists to sort or merge. */
+    list_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Does the sort job in JOB_.  Has the signature of a thread
+   function. */
+static void *
+do_sort_job (void *job_)
+{
+  struct sort_job *job = job_;
+
+  if (job->b == NULL)
+    list_sort_array (job->a, job->less, job->aux);
+  else
+    merge_lists (job->a, job->b, job->less, job->aux);
+  return NULL;
+}
+
+/* Runs the CNT jobs in JOBS in parallel, one thread per job, with
+   the calling thread taking the last one and any whose thread
+   can't be created, and returns once they have all finished. */
+static void
+run_sort_jobs (struct sort_job *jobs, pthread_t *threads, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (i == cnt - 1
+        || pthread_create (&threads[i], NULL, do_sort_job, &jobs[i]) != 0)
+      {
+        do_sort_job (&jobs[i]);
+        jobs[i].a = NULL;
+      }
+  for (i = 0; i < cnt; i++)
+    if (jobs[i].a != NULL)
+      pthread_join (threads[i], NULL);
+}
+
+/* Sorts LIST according to LESS given auxiliary data AUX, like
+   list_sort(), and just as stably, using up to THREAD_CNT
+   threads, the calling thread included.
+
+   LIST is cut into THREAD_CNT sublists of about equal length,
+   which are sorted in parallel with list_sort_array(), and then
+   merged pairwise, again in parallel, until one list is left.
+   LESS is called from several threads at once, so it must not
+   modify shared state.  Short lists use fewer threads, and if
+   memory for the bookkeeping can't be allocated, LIST is sorted
+   on the calling thread alone. */
+void
+list_sort_parallel (struct list *list, list_less_func *less, void *aux,
+                    size_t thread_cnt)
+{
+  size_t cnt = list_size (list);
+  struct list *parts;
+  struct sort_job *jobs;
+  pthread_t *threads;
+  size_t part_cnt, i, step;
+
+  ASSERT (list != NULL);
+  ASSERT (less != NULL);
+
+  if (thread_cnt > cnt / MIN_SORT_ELEMS_PER_THREAD)
+    thread_cnt = cnt / MIN_SORT_ELEMS_PER_THREAD;
+  parts = malloc (sizeof *parts * thread_cnt);
+  jobs = malloc (sizeof *jobs * thread_cnt);
+  threads = malloc (sizeof *threads * thread_cnt);
+  if (thread_cnt <= 1 || parts == NULL || jobs == NULL || threads == NULL)
+    {
+      free (parts);
+      free (jobs);
+      free (threads);
+      list_sort_array (list, less, aux);
+      return;
+    }
+  part_cnt = thread_cnt;
+
+  /* Cut LIST into consecutive parts and sort them. */
+  for (i = 0; i < part_cnt; i++)
+    {
+      size_t part_size = cnt * (i + 1) / part_cnt - cnt * i / part_cnt;
+      struct list_elem *last = list_begin (list);
+      size_t j;
+
+      for (j = 0; j < part_size; j++)
+        last = list_next (last);
+      list_init (&parts[i]);
+      list_splice_cnt (&parts[i], list_end (&parts[i]), list,
+                       list_begin (list), last, part_size);
+      jobs[i].a = &parts[i];
+      jobs[i].b = NULL;
+      jobs[i].less = less;
+      jobs[i].aux = aux;
+    }
+  run_sort_jobs (jobs, threads, part_cnt);
+
+  /* Merge neighboring parts, left into right order, until one is
+     left.  Merging part I+STEP into part I keeps the elements of
+     earlier parts ahead of equal elements of later ones. */
+  for (step = 1; step < part_cnt; step *= 2)
+    {
+      size_t job_cnt = 0;
+
+      for (i = 0; i + step < part_cnt; i += 2 * step)
+        {
+          jobs[job_cnt].a = &parts[i];
+          jobs[job_cnt].b = &parts[i + step];
+          jobs[job_cnt].less = less;
+          jobs[job_cnt].aux = aux;
+          job_cnt++;
+        }
+      run_sort_jobs (jobs, threads, job_cnt);
+    }
+
+  list_splice_cnt (list, list_end (list), &parts[0], list_begin (&parts[0]),
+                   list_end (&parts[0]), list_size (&parts[0]));
+  free (parts);
+  free (jobs);
+  free (threads);
+  ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
+}
+
 /* Inserts ELEM in the proper position in LIST, which must be
    sorted according to LESS given auxiliary data AUX.
    Runs in O(n) average case in the number of elements in LIST. */
@@ -529,7 +1000,7 @@ list_insert_ordered (struct list *list, struct list_elem *elem,
   for (e = list_begin (list); e != list_end (list); e = list_next (e))
     if (less (elem, e, aux))
       break;
-  return list_insert (e, elem);
+  return list_insert (list, e, elem);
 }
 
 /* Iterates through LIST and removes all but the first in each
@@ -551,7 +1022,7 @@ list_unique (struct list *list, struct list *duplicates,
   while ((next = list_next (elem)) != list_end (list))
     if (!less (elem, next, aux) && !less (next, elem, aux)) 
       {
-        list_remove (next);
+        list_remove (list, next);
         if (duplicates != NULL)
           list_push_back (duplicates, next);
       }
@@ -599,6 +1070,75 @@ list_min (struct list *list, list_less_func *less, void *aux)
 
 /*Additional implement for processing*/
 
+/* All list items come from one pool shared by every list, so
+   that list_splice() and list_unique() can move items between
+   lists without copying them.
+
+   Freed items go on FREE_ITEMS, a list of items ready for reuse,
+   rather than back to the pool.  That way delete_list() frees a
+   whole list by splicing it onto FREE_ITEMS, in constant time.
+   Once the last list is deleted, nothing can refer to any item,
+   and the pool itself is released. */
+static struct pool item_pool = POOL_INITIALIZER (sizeof (struct list_item));
+static struct list free_items;
+
+/* Number of lists in existence.  FREE_ITEMS is initialized when
+   the first list is created. */
+static size_t live_list_cnt;
+
+/* Returns a new list item holding VALUE, or a null pointer if
+   memory allocation failed. */
+static struct list_elem *
+new_item (int value)
+{
+  struct list_item *item;
+
+  if (!list_empty (&free_items))
+    item = list_entry (list_pop_front (&free_items), struct list_item, elem);
+  else
+    {
+      item = pool_alloc (&item_pool);
+      if (item == NULL)
+        return NULL;
+    }
+  item->data = value;
+
+  return &item->elem;
+}
+
+/* Frees list element E's item, which must not be in any list. */
+static void
+free_item (struct list_elem *e)
+{
+  list_push_front (&free_items, e);
+}
+
+/* Frees every item in LIST, leaving it empty. */
+static void
+free_all_items (struct list *list)
+{
+  if (!list_empty (list))
+    list_splice_cnt (&free_items, list_begin (&free_items), list,
+                     list_begin (list), list_end (list), list_size (list));
+}
+
+/* Skip-list indexes for the lists in main()'s list slots.  A
+   list gets one on its first ordered insertion while it is
+   sorted, and loses it on any change that might unsort it. */
+static struct skiplist *indexes[LIST_SLOT_CNT];
+
+/* Drops the skip-list index, if any, of the list in slot INDEX. */
+static void
+drop_index (int index)
+{
+  if (indexes[index] != NULL)
+    {
+      skiplist_destroy (indexes[index]);
+      free (indexes[index]);
+      indexes[index] = NULL;
+    }
+}
+
 /* For using list_less_func */
 bool
 less (const struct list_elem *a, const struct list_elem *b, void *aux)
@@ -617,6 +1157,8 @@ create_list (struct list **List, char *list_name)
 
   struct list *new_list = (struct list *) calloc (1, sizeof(struct list));
   list_init (new_list);
+  if (live_list_cnt++ == 0)
+    list_init (&free_items);
 
   List[index] = new_list;
 
@@ -630,12 +1172,13 @@ delete_list (struct list **List, char *list_name)
 
   ASSERT (List[index] != NULL);
 
-  while (!list_empty (List[index]))
-    {
-      struct list_elem *e = list_pop_front (List[index]);
-    }
+  drop_index (index);
+  free_all_items (List[index]);
+  if (--live_list_cnt == 0)
+    pool_destroy (&item_pool);
 
   free(List[index]);
+  List[index] = NULL;
 
   return;
 }
@@ -669,16 +1212,21 @@ find_elem (struct list *list, int position)
   return e;
 }
 
-void
+/* Inserts VALUE into the list named LIST_NAME at POSITION, or at
+   the back if POSITION is -1.  Returns false if memory allocation
+   failed, in which case the list is unchanged. */
+bool
 insert_elem_list (struct list **List, char *list_name, int position, int value)
 {
   int index = atoi (list_name + 4);
 
   ASSERT (List[index] != NULL);
 
-  struct list_elem *new_elem = (struct list_elem *) calloc (1, sizeof (struct list_elem));
-  list_entry (new_elem, struct list_item, elem)->data = value;
+  struct list_elem *new_elem = new_item (value);
+  if (new_elem == NULL)
+    return false;
 
+  drop_index (index);
   if (position == -1)
     list_push_back (List[index], new_elem);
   else if (position == 0)
@@ -686,10 +1234,10 @@ insert_elem_list (struct list **List, char *list_name, int position, int value)
   else
     {
       struct list_elem *p = find_elem (List[index], position);
-      list_insert (p, new_elem);
+      list_insert (List[index], p, new_elem);
     }
 
-  return;
+  return true;
 }
 
 void
@@ -711,19 +1259,35 @@ print_list (struct list **List, char *list_name, int position)
   return;
 }
 
-void
+/* Inserts VALUE into the list named LIST_NAME in sorted order.
+   Returns false if memory allocation failed, in which case the
+   list is unchanged. */
+bool
 ordered_insert_elem_list (struct list **List, char *list_name, int value)
 {
   int index = atoi (list_name + 4);
 
   ASSERT (List[index] != NULL);
 
-  struct list_elem *new_elem = (struct list_elem *) calloc (1, sizeof (struct list_elem));
-  list_entry (new_elem, struct list_item, elem)->data = value;
+  struct list_elem *new_elem = new_item (value);
+  if (new_elem == NULL)
+    return false;
 
-  list_insert_ordered (List[index], new_elem, less, NULL);
+  if (indexes[index] == NULL
+      && is_sorted (list_begin (List[index]), list_end (List[index]),
+                    less, NULL))
+    {
+      indexes[index] = malloc (sizeof *indexes[index]);
+      if (indexes[index] != NULL)
+        skiplist_init (indexes[index], List[index], less, NULL);
+    }
 
-  return;
+  if (indexes[index] != NULL)
+    skiplist_insert (indexes[index], new_elem);
+  else
+    list_insert_ordered (List[index], new_elem, less, NULL);
+
+  return true;
 }
 
 void
@@ -733,15 +1297,20 @@ remove_elem_list (struct list **List, char *list_name, int position)
 
   ASSERT (List[index] != NULL);
 
+  struct list_elem *p;
+
   if (position == -1)
-    list_pop_back (List[index]);
+    p = list_back (List[index]);
   else if (position == 0)
-    list_pop_front (List[index]);
+    p = list_front (List[index]);
   else
-    {
-      struct list_elem *p = find_elem (List[index], position);
-      list_remove (p);
-    }
+    p = find_elem (List[index], position);
+
+  if (indexes[index] != NULL)
+    skiplist_remove (indexes[index], p);
+  else
+    list_remove (List[index], p);
+  free_item (p);
 
   return;
 }
@@ -777,6 +1346,7 @@ shuffle_list (struct list **List, char *list_name)
 
   ASSERT (List[index] != NULL);
 
+  drop_index (index);
   list_shuffle(List[index]);
 
   return;
@@ -792,7 +1362,38 @@ splice_list (struct list *a, struct list *b, int index, int start, int end)
   struct list_elem *first = find_elem (b, start);
   struct list_elem *last = find_elem (b, end);
   
-  list_splice (before, first, last);
+  list_splice (a, before, b, first, last);
+
+  return;
+}
+
+/* Removes all but the first of each run of equal adjacent items
+   in the list named LIST_NAME.  If DUP_NAME is non-null, the
+   removed items are appended to the list by that name; otherwise,
+   they are freed. */
+void
+unique_list (struct list **List, char *list_name, char *dup_name)
+{
+  int index = atoi (list_name + 4);
+  struct list removed;
+
+  ASSERT (List[index] != NULL);
+
+  drop_index (index);
+  if (dup_name != NULL)
+    {
+      int dup_index = atoi (dup_name + 4);
+
+      ASSERT (List[dup_index] != NULL);
+      drop_index (dup_index);
+      list_unique (List[index], List[dup_index], less, NULL);
+    }
+  else
+    {
+      list_init (&removed);
+      list_unique (List[index], &removed, less, NULL);
+      free_all_items (&removed);
+    }
 
   return;
 }
@@ -807,7 +1408,20 @@ swap_list (struct list **List, char *list_name, int position1, int position2)
   struct list_elem *e1 = find_elem (List[index], position1);
   struct list_elem *e2 = find_elem (List[index], position2);
 
+  drop_index (index);
   list_swap (e1, e2);
 
   return;
-}
\ No newline at end of file
+}
+
+void
+unindex_list (struct list **List, char *list_name)
+{
+  int index = atoi (list_name + 4);
+
+  ASSERT (List[index] != NULL);
+
+  drop_index (index);
+
+  return;
+}
@@ -94,6 +94,7 @@ struct list
   {
     struct list_elem head;      /* List head. */
     struct list_elem tail;      /* List tail. */
+    size_t elem_cnt;            /* Number of elements. */
   };
 
 struct list_item
@@ -126,14 +127,20 @@ struct list_elem *list_head (struct list *);
 struct list_elem *list_tail (struct list *);
 
 /* List insertion. */
-void list_insert (struct list_elem *, struct list_elem *);
-void list_splice (struct list_elem *before,
+void list_insert (struct list *, struct list_elem *before,
+                  struct list_elem *);
+void list_splice (struct list *, struct list_elem *before,
+                  struct list *from,
                   struct list_elem *first, struct list_elem *last);
+void list_splice_cnt (struct list *, struct list_elem *before,
+                      struct list *from,
+                      struct list_elem *first, struct list_elem *last,
+                      size_t cnt);
 void list_push_front (struct list *, struct list_elem *);
 void list_push_back (struct list *, struct list_elem *);
 
 /* List removal. */
-struct list_elem *list_remove (struct list_elem *);
+struct list_elem *list_remove (struct list *, struct list_elem *);
 struct list_elem *list_pop_front (struct list *);
 struct list_elem *list_pop_back (struct list *);
 
@@ -155,9 +162,18 @@ typedef bool list_less_func (const struct list_elem *a,
                              const struct list_elem *b,
                              void *aux);
 
+/* Returns the sort key of list element E, given auxiliary data
+   AUX. */
+typedef int list_key_func (const struct list_elem *e, void *aux);
+
 /* Operations on lists with ordered elements. */
 void list_sort (struct list *,
                 list_less_func *, void *aux);
+void list_sort_array (struct list *,
+                      list_less_func *, void *aux);
+void list_sort_by_key (struct list *, list_key_func *, void *aux);
+void list_sort_parallel (struct list *, list_less_func *, void *aux,
+                         size_t thread_cnt);
 void list_insert_ordered (struct list *, struct list_elem *,
                           list_less_func *, void *aux);
 void list_unique (struct list *, struct list *duplicates,
@@ -172,17 +188,22 @@ void list_shuffle(struct list *);
 
 bool less (const struct list_elem *, const struct list_elem *, void *aux);
 
+/* Number of list slots in main(), list0 through list19. */
+#define LIST_SLOT_CNT 20
+
 void create_list (struct list **, char *);
 void delete_list (struct list **, char *);
 void dumpdata_list (struct list **, char *);
-void insert_elem_list (struct list **, char *, int, int);
+bool insert_elem_list (struct list **, char *, int, int);
 void print_list (struct list **, char *, int);
-void ordered_insert_elem_list (struct list **, char *, int);
+bool ordered_insert_elem_list (struct list **, char *, int);
 void remove_elem_list (struct list **, char *, int);
 void print_max_elem_list (struct list **, char *);
 void print_min_elem_list (struct list **, char *);
 void shuffle_list (struct list **, char *);
 void splice_list (struct list *, struct list *, int, int, int);
 void swap_list (struct list **, char *, int, int);
+void unique_list (struct list **, char *, char *);
+void unindex_list (struct list **, char *);
 
 #endif /* list.h */
@@ -18,9 +18,9 @@ int main()
 
     int argc;
     char input[110], argv[10][50] = {};
-    struct list **main_list = (struct list **)calloc(20, sizeof(struct list *));
-    struct hash **main_hash = (struct hash **)calloc(20, sizeof(struct hash *));
-    struct bitmap **main_bitmap = (struct bitmap **)calloc(20, sizeof(struct bitmap *));
+    struct list **main_list = (struct list **)calloc(LIST_SLOT_CNT, sizeof(struct list *));
+    struct hash **main_hash = (struct hash **)calloc(HASH_SLOT_CNT, sizeof(struct hash *));
+    struct bitmap **main_bitmap = (struct bitmap **)calloc(BITMAP_SLOT_CNT, sizeof(struct bitmap *));
 
     while (fgets(input, 110, stdin) != NULL)
     {
@@ -46,11 +46,13 @@ int main()
 
             else if (!strcmp(argv[0], "list_push_front"))
             {
-                insert_elem_list(main_list, argv[1], 0, atoi(argv[2]));
+                if (!insert_elem_list(main_list, argv[1], 0, atoi(argv[2])))
+                    fprintf(stderr, "out of memory\n");
             }
             else if (!strcmp(argv[0], "list_push_back"))
             {
-                insert_elem_list(main_list, argv[1], -1, atoi(argv[2]));
+                if (!insert_elem_list(main_list, argv[1], -1, atoi(argv[2])))
+                    fprintf(stderr, "out of memory\n");
             }
             else if (!strcmp(argv[0], "list_front"))
             {
@@ -63,11 +65,13 @@ int main()
 
             else if (!strcmp(argv[0], "list_insert"))
             {
-                insert_elem_list(main_list, argv[1], atoi(argv[2]), atoi(argv[3]));
+                if (!insert_elem_list(main_list, argv[1], atoi(argv[2]), atoi(argv[3])))
+                    fprintf(stderr, "out of memory\n");
             }
             else if (!strcmp(argv[0], "list_insert_ordered"))
             {
-                ordered_insert_elem_list(main_list, argv[1], atoi(argv[2]));
+                if (!ordered_insert_elem_list(main_list, argv[1], atoi(argv[2])))
+                    fprintf(stderr, "out of memory\n");
             }
 
             else if (!strcmp(argv[0], "list_pop_front"))
@@ -105,6 +109,7 @@ int main()
 
             else if (!strcmp(argv[0], "list_reverse"))
             {
+                unindex_list(main_list, argv[1]);
                 list_reverse(main_list[atoi(argv[1] + 4)]);
             }
             else if (!strcmp(argv[0], "list_shuffle"))
@@ -113,10 +118,13 @@ int main()
             }
             else if (!strcmp(argv[0], "list_sort"))
             {
+                unindex_list(main_list, argv[1]);
                 list_sort(main_list[atoi(argv[1] + 4)], less, NULL);
             }
             else if (!strcmp(argv[0], "list_splice"))
             {
+                unindex_list(main_list, argv[1]);
+                unindex_list(main_list, argv[3]);
                 splice_list(main_list[atoi(argv[1] + 4)], main_list[atoi(argv[3] + 4)], atoi(argv[2]), atoi(argv[4]), atoi(argv[5]));
             }
             else if (!strcmp(argv[0], "list_swap"))
@@ -125,10 +133,7 @@ int main()
             }
             else if (!strcmp(argv[0], "list_unique"))
             {
-                if (argc == 2)
-                    list_unique(main_list[atoi(argv[1] + 4)], NULL, less, NULL);
-                else
-                    list_unique(main_list[atoi(argv[1] + 4)], main_list[atoi(argv[2] + 4)], less, NULL);
+                unique_list(main_list, argv[1], argc == 2 ? NULL : argv[2]);
             }
         }
 
@@ -149,11 +154,24 @@ int main()
 
             else if (!strcmp(argv[0], "hash_insert"))
             {
-                hash_insert(main_hash[atoi(argv[1] + 4)], new_elem(atoi(argv[2])));
+                struct hash *h = main_hash[atoi(argv[1] + 4)];
+                struct hash_elem *e = new_elem(h, atoi(argv[2]));
+                if (e == NULL)
+                    fprintf(stderr, "out of memory\n");
+                else if (hash_insert(h, e) != NULL)
+                    hash_destruct(e, h->aux);
             }
             else if (!strcmp(argv[0], "hash_delete"))
             {
-                hash_delete(main_hash[atoi(argv[1] + 4)], new_elem(atoi(argv[2])));
+                struct hash *h = main_hash[atoi(argv[1] + 4)];
+                struct hash_elem *e = new_elem(h, atoi(argv[2]));
+                if (e == NULL)
+                    fprintf(stderr, "out of memory\n");
+                else
+                {
+                    hash_destruct(hash_delete(h, e), h->aux);
+                    hash_destruct(e, h->aux);
+                }
             }
             else if (!strcmp(argv[0], "hash_empty"))
             {
@@ -168,7 +186,7 @@ int main()
             }
             else if (!strcmp(argv[0], "hash_clear"))
             {
-                hash_clear(main_hash[atoi(argv[1] + 4)], hash_destruct);
+                clear_hash(main_hash, argv[1]);
             }
 
             else if (!strcmp(argv[0], "hash_apply"))
@@ -180,12 +198,25 @@ int main()
             }
             else if (!strcmp(argv[0], "hash_find"))
             {
-                if (hash_find(main_hash[atoi(argv[1] + 4)], new_elem(atoi(argv[2]))))
-                    printf("%d\n", atoi(argv[2]));
+                struct hash *h = main_hash[atoi(argv[1] + 4)];
+                struct hash_elem *e = new_elem(h, atoi(argv[2]));
+                if (e == NULL)
+                    fprintf(stderr, "out of memory\n");
+                else
+                {
+                    if (hash_find(h, e))
+                        printf("%d\n", atoi(argv[2]));
+                    hash_destruct(e, h->aux);
+                }
             }
             else if (!strcmp(argv[0], "hash_replace"))
             {
-                hash_replace(main_hash[atoi(argv[1] + 4)], new_elem(atoi(argv[2])));
+                struct hash *h = main_hash[atoi(argv[1] + 4)];
+                struct hash_elem *e = new_elem(h, atoi(argv[2]));
+                if (e == NULL)
+                    fprintf(stderr, "out of memory\n");
+                else
+                    hash_destruct(hash_replace(h, e), h->aux);
             }
         }
 
@@ -198,6 +229,7 @@ int main()
             else if (!strcmp(argv[0], "delete"))
             {
                 bitmap_destroy(main_bitmap[atoi(argv[1] + 2)]);
+                main_bitmap[atoi(argv[1] + 2)] = NULL;
             }
             else if (!strcmp(argv[0], "dumpdata"))
             {
@@ -278,11 +310,31 @@ int main()
             }
             else if(!strcmp(argv[0], "bitmap_expand"))
             {
-                main_bitmap[atoi(argv[1] + 2)] = bitmap_expand(main_bitmap[atoi(argv[1] + 2)], (size_t)atoi(argv[2]));
+                struct bitmap *res = bitmap_expand(main_bitmap[atoi(argv[1] + 2)], (size_t)atoi(argv[2]));
+                if (res != NULL)
+                    main_bitmap[atoi(argv[1] + 2)] = res;
             }
         }
     }
 
+    /* Tear down whatever the input left behind. */
+    char name[16];
+
+    for (int i = 0; i < LIST_SLOT_CNT; i++)
+    {
+        snprintf(name, sizeof name, "list%d", i);
+        if (main_list[i] != NULL)
+            delete_list(main_list, name);
+    }
+    for (int i = 0; i < HASH_SLOT_CNT; i++)
+    {
+        snprintf(name, sizeof name, "hash%d", i);
+        if (main_hash[i] != NULL)
+            delete_hash(main_hash, name);
+    }
+    for (int i = 0; i < BITMAP_SLOT_CNT; i++)
+        bitmap_destroy(main_bitmap[i]);
+
     free(main_list);
     free(main_hash);
     free(main_bitmap);
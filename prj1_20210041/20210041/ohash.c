@@ -0,0 +1,331 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+static long find_slot (struct ohash *, struct hash_elem *, unsigned hash);
+static void place (struct ohash *, struct hash_elem *, unsigned hash);
+static void remove_slot (struct ohash *, size_t idx);
+static bool resize (struct ohash *, size_t new_slot_cnt);
+static void maybe_grow (struct ohash *);
+static void maybe_shrink (struct ohash *);
+
+/* Smallest number of slots, a power of 2. */
+#define MIN_SLOTS 8
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+ohash_init (struct ohash *h,
+            hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  h->elem_cnt = 0;
+  h->slot_cnt = MIN_SLOTS;
+  h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+
+  return h->slots != NULL;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ohash_clear() is running, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *h, hash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      {
+        if (destructor != NULL)
+          destructor (h->slots[i].elem, h->aux);
+        h->slots[i].elem = NULL;
+      }
+
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, with the same restrictions as in
+   ohash_clear(). */
+void
+ohash_destroy (struct ohash *h, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_clear (h, destructor);
+  free (h->slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct hash_elem *
+ohash_insert (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  long idx = find_slot (h, new, hash);
+
+  if (idx >= 0)
+    return h->slots[idx].elem;
+
+  maybe_grow (h);
+  place (h, new, hash);
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct hash_elem *
+ohash_replace (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  long idx = find_slot (h, new, hash);
+  struct hash_elem *old;
+
+  if (idx >= 0)
+    {
+      /* Equal elements hash alike, so NEW can take OLD's slot. */
+      old = h->slots[idx].elem;
+      h->slots[idx].elem = new;
+      return old;
+    }
+
+  maybe_grow (h);
+  place (h, new, hash);
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct hash_elem *
+ohash_find (struct ohash *h, struct hash_elem *e)
+{
+  long idx = find_slot (h, e, h->hash (e, h->aux));
+  return idx >= 0 ? h->slots[idx].elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct hash_elem *
+ohash_delete (struct ohash *h, struct hash_elem *e)
+{
+  long idx = find_slot (h, e, h->hash (e, h->aux));
+  struct hash_elem *found;
+
+  if (idx < 0)
+    return NULL;
+
+  found = h->slots[idx].elem;
+  remove_slot (h, idx);
+  h->elem_cnt--;
+  maybe_shrink (h);
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ohash_apply() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *h, hash_action_func *action)
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      action (h->slots[i].elem, h->aux);
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns how far slot IDX of H is from the slot its element's
+   hash prefers.  The slot must not be empty. */
+static inline size_t
+probe_dist (const struct ohash *h, size_t idx)
+{
+  return (idx - (h->slots[idx].hash & (h->slot_cnt - 1))) & (h->slot_cnt - 1);
+}
+
+/* Returns the index of the slot in H that holds an element equal
+   to E, whose hash is HASH, or -1 if there is none.
+
+   Robin Hood ordering keeps entries sorted by probe distance
+   along a run, so the search can stop as soon as it meets an
+   entry that is closer to home than E would be. */
+static long
+find_slot (struct ohash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t idx = hash & mask;
+  size_t dist;
+
+  for (dist = 0; ; dist++, idx = (idx + 1) & mask)
+    {
+      struct ohash_slot *s = &h->slots[idx];
+
+      if (s->elem == NULL || probe_dist (h, idx) < dist)
+        return -1;
+      if (s->hash == hash
+          && !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+        return idx;
+    }
+}
+
+/* Puts E, whose hash is HASH, into H, which must not already
+   contain it and must have an empty slot.  Along the way, E
+   displaces any entry that is closer to its preferred slot,
+   which then continues on in E's place. */
+static void
+place (struct ohash *h, struct hash_elem *e, unsigned hash)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t idx = hash & mask;
+  size_t dist = 0;
+
+  ASSERT (h->elem_cnt < h->slot_cnt);
+
+  for (;;)
+    {
+      struct ohash_slot *s = &h->slots[idx];
+      size_t s_dist;
+
+      if (s->elem == NULL)
+        {
+          s->elem = e;
+          s->hash = hash;
+          return;
+        }
+
+      s_dist = probe_dist (h, idx);
+      if (s_dist < dist)
+        {
+          struct hash_elem *t_elem = s->elem;
+          unsigned t_hash = s->hash;
+
+          s->elem = e;
+          s->hash = hash;
+          e = t_elem;
+          hash = t_hash;
+          dist = s_dist;
+        }
+      idx = (idx + 1) & mask;
+      dist++;
+    }
+}
+
+/* Empties slot IDX of H, then shifts each following entry of the
+   same run back by one slot, so that lookups never need to skip
+   over deleted slots. */
+static void
+remove_slot (struct ohash *h, size_t idx)
+{
+  size_t mask = h->slot_cnt - 1;
+
+  for (;;)
+    {
+      size_t next = (idx + 1) & mask;
+
+      if (h->slots[next].elem == NULL || probe_dist (h, next) == 0)
+        break;
+      h->slots[idx] = h->slots[next];
+      idx = next;
+    }
+  h->slots[idx].elem = NULL;
+}
+
+/* Changes the number of slots in H to NEW_SLOT_CNT, a power of 2
+   that can hold all of H's elements.  Entries are moved using
+   their stored hashes, without calling the hash function.
+   Returns false if memory allocation failed, in which case H is
+   unchanged. */
+static bool
+resize (struct ohash *h, size_t new_slot_cnt)
+{
+  struct ohash_slot *old_slots = h->slots;
+  size_t old_slot_cnt = h->slot_cnt;
+  size_t i;
+
+  h->slots = calloc (new_slot_cnt, sizeof *h->slots);
+  if (h->slots == NULL)
+    {
+      h->slots = old_slots;
+      return false;
+    }
+  h->slot_cnt = new_slot_cnt;
+
+  for (i = 0; i < old_slot_cnt; i++)
+    if (old_slots[i].elem != NULL)
+      place (h, old_slots[i].elem, old_slots[i].hash);
+
+  free (old_slots);
+  return true;
+}
+
+/* Slot-count ratios.  The table grows once it would be more
+   than 7/8 full and shrinks once it is less than 1/8 full, which
+   leaves plenty of room between the two to avoid thrashing. */
+#define MAX_LOAD_NUM 7
+#define MAX_LOAD_DEN 8
+#define MIN_LOAD_DEN 8
+
+/* Doubles the number of slots in H if one more element would
+   take it past its maximum load.  If that fails for lack of
+   memory, H stays usable at a higher load, as long as at least
+   one slot is free. */
+static void
+maybe_grow (struct ohash *h)
+{
+  if ((h->elem_cnt + 1) * MAX_LOAD_DEN > h->slot_cnt * MAX_LOAD_NUM)
+    resize (h, h->slot_cnt * 2);
+  ASSERT (h->elem_cnt + 1 < h->slot_cnt);
+}
+
+/* Halves the number of slots in H if it has become sparse.  This
+   can fail because of an out-of-memory condition, but that'll
+   just leave H larger than it needs to be. */
+static void
+maybe_shrink (struct ohash *h)
+{
+  if (h->slot_cnt > MIN_SLOTS && h->elem_cnt * MIN_LOAD_DEN < h->slot_cnt)
+    resize (h, h->slot_cnt / 2);
+}
@@ -0,0 +1,58 @@
+#ifndef __MYLIB_OHASH_H
+#define __MYLIB_OHASH_H
+
+/* Open-addressing hash table.
+
+   An alternative to the chained table in hash.h with the same
+   element type, callbacks and insert/find/delete/replace/apply
+   semantics.  Instead of threading each element onto a bucket
+   list, the table keeps one flat array of slots, each holding an
+   element pointer next to that element's full hash value.
+   Collisions are resolved by linear probing with Robin Hood
+   ordering, so a lookup reads a short, contiguous run of slots
+   and only calls the comparison function on slots whose stored
+   hash matches.  Deletion shifts later entries back, so no
+   tombstones build up. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* One slot of an open-addressing table. */
+struct ohash_slot
+  {
+    struct hash_elem *elem;     /* Element, or null if empty. */
+    unsigned hash;              /* Hash of elem, if non-null. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, hash_hash_func *, hash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, hash_action_func *);
+void ohash_destroy (struct ohash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *ohash_insert (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_replace (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_find (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_delete (struct ohash *, struct hash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, hash_action_func *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* ohash.h */
@@ -0,0 +1,134 @@
+/* Fixed-size node pool.
+
+   See pool.h for basic information. */
+
+#include "pool.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Chunk header.  The chunk's elements follow it directly; the
+   union keeps them aligned. */
+struct pool_chunk
+  {
+    union
+      {
+        struct pool_chunk *next;        /* Next older chunk. */
+        max_align_t align;
+      };
+  };
+
+/* A freed element, linked into its pool's free list through its
+   first bytes. */
+struct pool_free
+  {
+    struct pool_free *next;
+  };
+
+/* Chunk sizes, in elements.  Chunks start small, so that pools
+   for small containers stay small, and double up to a limit, so
+   that a big pool needs few chunks yet never has more than one
+   largely unused one. */
+#define MIN_CHUNK_ELEMS 64
+#define MAX_CHUNK_BYTES (256 * 1024)
+
+/* Initializes P as an empty pool of elements of ELEM_SIZE bytes
+   each.  P allocates no memory until elements are requested. */
+void
+pool_init (struct pool *p, size_t elem_size)
+{
+  ASSERT (p != NULL);
+  ASSERT (elem_size > 0);
+
+  p->elem_size = ROUND_UP (elem_size, POOL_ALIGN);
+  p->chunk_elems = 0;
+  p->chunks = NULL;
+  p->next = p->end = NULL;
+  p->free = NULL;
+}
+
+/* Frees all the memory owned by P, which releases every element
+   ever allocated from it at once, whether it was freed or not.
+   Afterward, P is empty again and may be reused. */
+void
+pool_destroy (struct pool *p)
+{
+  struct pool_chunk *c, *next;
+
+  ASSERT (p != NULL);
+
+  for (c = p->chunks; c != NULL; c = next)
+    {
+      next = c->next;
+      free (c);
+    }
+  pool_init (p, p->elem_size);
+}
+
+/* Adds a new chunk to P, making its elements available to
+   pool_alloc().  Returns false if memory allocation failed. */
+static bool
+add_chunk (struct pool *p)
+{
+  struct pool_chunk *c;
+  size_t max_elems = MAX_CHUNK_BYTES / p->elem_size;
+
+  if (p->chunk_elems == 0)
+    p->chunk_elems = MIN_CHUNK_ELEMS;
+  else if (p->chunk_elems * 2 <= max_elems)
+    p->chunk_elems *= 2;
+
+  c = malloc (sizeof *c + p->chunk_elems * p->elem_size);
+  if (c == NULL)
+    return false;
+  c->next = p->chunks;
+  p->chunks = c;
+  p->next = (char *) (c + 1);
+  p->end = p->next + p->chunk_elems * p->elem_size;
+  return true;
+}
+
+/* Allocates and returns a zero-filled element from P, reusing a
+   freed element if there is one.  Returns a null pointer if
+   memory allocation failed. */
+void *
+pool_alloc (struct pool *p)
+{
+  void *e;
+
+  ASSERT (p != NULL);
+
+  if (p->free != NULL)
+    {
+      e = p->free;
+      p->free = p->free->next;
+    }
+  else
+    {
+      if (p->next == p->end && !add_chunk (p))
+        return NULL;
+      e = p->next;
+      p->next += p->elem_size;
+    }
+  return memset (e, 0, p->elem_size);
+}
+
+/* Returns element E, which must have been allocated from P, to
+   P for reuse.  E may be a null pointer, in which case nothing
+   happens. */
+void
+pool_free (struct pool *p, void *e_)
+{
+  struct pool_free *e = e_;
+
+  ASSERT (p != NULL);
+
+  if (e != NULL)
+    {
+      e->next = p->free;
+      p->free = e;
+    }
+}
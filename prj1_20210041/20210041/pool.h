@@ -0,0 +1,50 @@
+#ifndef __MYLIB_POOL_H
+#define __MYLIB_POOL_H
+
+/* Fixed-size node pool.
+
+   Hands out elements of a single size, such as struct hash_elem
+   or struct list_item, carved from large chunks instead of
+   calling malloc() once per element.  Elements allocated one
+   after another sit next to each other in memory, freeing an
+   element just puts it on a free list for reuse, and
+   pool_destroy() releases every element at once by freeing the
+   chunks, without visiting the elements.
+
+   Elements are aligned to POOL_ALIGN bytes, which suffices for
+   the node types in this library. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "round.h"
+
+/* Alignment of pool elements, in bytes. */
+#define POOL_ALIGN 8
+
+/* Node pool. */
+struct pool
+  {
+    size_t elem_size;           /* Element size, a multiple of POOL_ALIGN. */
+    size_t chunk_elems;         /* Number of elements in the next chunk. */
+    struct pool_chunk *chunks;  /* All chunks, newest first. */
+    char *next;                 /* Next never-used element of newest chunk. */
+    char *end;                  /* End of newest chunk. */
+    struct pool_free *free;     /* Freed elements, ready for reuse. */
+  };
+
+/* Initializer for a pool of elements of ELEM_SIZE bytes, for use
+   in place of pool_init(), as in:
+
+   static struct pool my_pool = POOL_INITIALIZER (sizeof (struct foo)); */
+#define POOL_INITIALIZER(ELEM_SIZE)                                     \
+        { ROUND_UP (ELEM_SIZE, POOL_ALIGN), 0, NULL, NULL, NULL, NULL }
+
+/* Basic life cycle. */
+void pool_init (struct pool *, size_t elem_size);
+void pool_destroy (struct pool *);
+
+/* Allocation. */
+void *pool_alloc (struct pool *);
+void pool_free (struct pool *, void *);
+
+#endif /* pool.h */
@@ -0,0 +1,277 @@
+/* Skip-list index over an ordered list.
+
+   See skiplist.h for basic information. */
+
+#include "skiplist.h"
+#include <assert.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Index node.  The nodes for one element, one per level it
+   reaches, are chained from the top down through `down'. */
+struct skiplist_node
+  {
+    struct list_elem *elem;             /* Indexed list element. */
+    struct skiplist_node *next;         /* Next node on this level. */
+    struct skiplist_node *down;         /* Same element one level down. */
+  };
+
+/* Returns a random number of index levels for a new element:
+   0 with probability 3/4, 1 with probability 3/16, and so on. */
+static int
+random_height (struct skiplist *sl)
+{
+  unsigned r = sl->seed;
+  int height = 0;
+
+  /* Xorshift. */
+  r ^= r << 13;
+  r ^= r >> 17;
+  r ^= r << 5;
+  sl->seed = r;
+
+  while ((r & 3) == 0 && height < SKIPLIST_MAX_LEVEL)
+    {
+      height++;
+      r >>= 2;
+    }
+  return height;
+}
+
+/* Returns true if list element E belongs before KEY: if E is
+   less than KEY or, if UPPER is true, equal to it. */
+static inline bool
+goes_before (struct skiplist *sl, const struct list_elem *e,
+             const struct list_elem *key, bool upper)
+{
+  return upper ? !sl->less (key, e, sl->aux) : sl->less (e, key, sl->aux);
+}
+
+/* Returns the first element of SL's list that does not go before
+   KEY, as defined by goes_before(), or the list's tail if there
+   is none.  If PREDS is non-null, stores in PREDS[L] the last
+   node on level L whose element goes before KEY, or a null
+   pointer if there is none, for each level in use. */
+static struct list_elem *
+search (struct skiplist *sl, const struct list_elem *key, bool upper,
+        struct skiplist_node **preds)
+{
+  struct skiplist_node *pred = NULL;
+  struct list_elem *e;
+  int level;
+
+  for (level = sl->level_cnt - 1; level >= 0; level--)
+    {
+      struct skiplist_node *next = pred != NULL ? pred->next : sl->heads[level];
+
+      while (next != NULL && goes_before (sl, next->elem, key, upper))
+        {
+          pred = next;
+          next = next->next;
+        }
+      if (preds != NULL)
+        preds[level] = pred;
+      if (level > 0 && pred != NULL)
+        pred = pred->down;
+    }
+
+  e = pred != NULL ? list_next (pred->elem) : list_begin (sl->list);
+  while (e != list_end (sl->list) && goes_before (sl, e, key, upper))
+    e = list_next (e);
+  return e;
+}
+
+/* Initializes SL as an index over LIST, which must be sorted
+   according to LESS given auxiliary data AUX, and indexes the
+   elements already in LIST.  This takes O(n) time.  If memory
+   for index nodes runs out, some elements go unindexed, which
+   makes searches slower but no less correct. */
+void
+skiplist_init (struct skiplist *sl, struct list *list,
+               list_less_func *less, void *aux)
+{
+  struct skiplist_node *tails[SKIPLIST_MAX_LEVEL];
+  struct list_elem *e;
+  int level;
+
+  ASSERT (sl != NULL);
+  ASSERT (list != NULL);
+  ASSERT (less != NULL);
+
+  sl->list = list;
+  sl->less = less;
+  sl->aux = aux;
+  sl->level_cnt = 0;
+  for (level = 0; level < SKIPLIST_MAX_LEVEL; level++)
+    sl->heads[level] = tails[level] = NULL;
+  pool_init (&sl->nodes, sizeof (struct skiplist_node));
+  sl->seed = 0x9e3779b9;
+
+  for (e = list_begin (list); e != list_end (list); e = list_next (e))
+    {
+      int height = random_height (sl);
+      struct skiplist_node *down = NULL;
+
+      ASSERT (e == list_begin (list) || !less (e, list_prev (e), aux));
+      for (level = 0; level < height; level++)
+        {
+          struct skiplist_node *node = pool_alloc (&sl->nodes);
+          if (node == NULL)
+            break;
+          node->elem = e;
+          node->down = down;
+          if (tails[level] != NULL)
+            tails[level]->next = node;
+          else
+            sl->heads[level] = node;
+          tails[level] = node;
+          down = node;
+        }
+      if (sl->level_cnt < level)
+        sl->level_cnt = level;
+    }
+}
+
+/* Destroys SL, freeing its index nodes.  The list it indexed,
+   and the elements in it, are left alone. */
+void
+skiplist_destroy (struct skiplist *sl)
+{
+  ASSERT (sl != NULL);
+
+  pool_destroy (&sl->nodes);
+}
+
+/* Inserts ELEM into SL's list in the proper position, after any
+   elements equal to it, just like list_insert_ordered(), and
+   indexes it. */
+void
+skiplist_insert (struct skiplist *sl, struct list_elem *elem)
+{
+  struct skiplist_node *preds[SKIPLIST_MAX_LEVEL];
+  struct skiplist_node *down = NULL;
+  struct list_elem *before;
+  int height, level;
+
+  ASSERT (sl != NULL);
+  ASSERT (elem != NULL);
+
+  before = search (sl, elem, true, preds);
+  list_insert (sl->list, before, elem);
+
+  /* search() filled in PREDS only for the levels in use.
+     random_height() never goes past SKIPLIST_MAX_LEVEL, but the
+     compiler cannot see that, so the loop checks it too. */
+  height = random_height (sl);
+  ASSERT (height <= SKIPLIST_MAX_LEVEL);
+  for (level = sl->level_cnt; level < height && level < SKIPLIST_MAX_LEVEL;
+       level++)
+    preds[level] = NULL;
+  for (level = 0; level < height; level++)
+    {
+      struct skiplist_node *node = pool_alloc (&sl->nodes);
+      if (node == NULL)
+        break;
+      node->elem = elem;
+      node->down = down;
+      if (preds[level] != NULL)
+        {
+          node->next = preds[level]->next;
+          preds[level]->next = node;
+        }
+      else
+        {
+          node->next = sl->heads[level];
+          sl->heads[level] = node;
+        }
+      down = node;
+    }
+  if (sl->level_cnt < level)
+    sl->level_cnt = level;
+}
+
+/* Removes ELEM, which must be in SL's list, from the list and
+   from SL, and returns the element that followed it, like
+   list_remove(). */
+struct list_elem *
+skiplist_remove (struct skiplist *sl, struct list_elem *elem)
+{
+  struct skiplist_node *pred = NULL;
+  int level;
+
+  ASSERT (sl != NULL);
+  ASSERT (elem != NULL);
+
+  for (level = sl->level_cnt - 1; level >= 0; level--)
+    {
+      struct skiplist_node *prev, *next;
+
+      next = pred != NULL ? pred->next : sl->heads[level];
+      while (next != NULL && sl->less (next->elem, elem, sl->aux))
+        {
+          pred = next;
+          next = next->next;
+        }
+
+      /* ELEM's node on this level, if it has one, is among the
+         nodes for elements equal to it. */
+      prev = pred;
+      while (next != NULL && next->elem != elem
+             && !sl->less (elem, next->elem, sl->aux))
+        {
+          prev = next;
+          next = next->next;
+        }
+      if (next != NULL && next->elem == elem)
+        {
+          if (prev != NULL)
+            prev->next = next->next;
+          else
+            sl->heads[level] = next->next;
+          pool_free (&sl->nodes, next);
+        }
+
+      if (level > 0 && pred != NULL)
+        pred = pred->down;
+    }
+  while (sl->level_cnt > 0 && sl->heads[sl->level_cnt - 1] == NULL)
+    sl->level_cnt--;
+
+  return list_remove (sl->list, elem);
+}
+
+/* Returns the first element of SL's list that is equal to KEY,
+   or a null pointer if there is none. */
+struct list_elem *
+skiplist_find (struct skiplist *sl, const struct list_elem *key)
+{
+  struct list_elem *e = skiplist_lower_bound (sl, key);
+
+  if (e != list_end (sl->list) && !sl->less (key, e, sl->aux))
+    return e;
+  return NULL;
+}
+
+/* Returns the first element of SL's list that is not less than
+   KEY, or the list's tail if there is none.  Together with
+   skiplist_upper_bound(), this gives the start and end of a
+   range of elements to walk with list_next(). */
+struct list_elem *
+skiplist_lower_bound (struct skiplist *sl, const struct list_elem *key)
+{
+  ASSERT (sl != NULL);
+  ASSERT (key != NULL);
+
+  return search (sl, key, false, NULL);
+}
+
+/* Returns the first element of SL's list that is greater than
+   KEY, or the list's tail if there is none. */
+struct list_elem *
+skiplist_upper_bound (struct skiplist *sl, const struct list_elem *key)
+{
+  ASSERT (sl != NULL);
+  ASSERT (key != NULL);
+
+  return search (sl, key, true, NULL);
+}
@@ -0,0 +1,63 @@
+#ifndef __MYLIB_SKIPLIST_H
+#define __MYLIB_SKIPLIST_H
+
+/* Skip-list index over an ordered list.
+
+   A struct skiplist indexes a struct list whose elements are
+   kept sorted by a list_less_func.  The list itself stays an
+   ordinary list, walkable with list_begin() and list_next(), and
+   serves as the bottom level of the skip list; the index adds
+   levels of nodes above it, each pointing to a list element and
+   to the next node on its level.  Each element gets a node on
+   the lowest index level with probability 1/4, and on each level
+   above that with probability 1/4 of the one below, so the index
+   costs about a third of a node per element, and ordered
+   insertion, removal, and lookup take O(log n) expected time
+   instead of a walk from the front of the list.
+
+   The list must only be changed through skiplist_insert() and
+   skiplist_remove() while the index exists.  Changing it any
+   other way, for example with list_push_back() or list_sort(),
+   leaves the index out of date; destroy it first and, once the
+   list is sorted again, initialize a new one. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "list.h"
+#include "pool.h"
+
+/* Maximum number of index levels.  With 1/4 of the elements on
+   each level promoted to the next, this suffices for about 4**16
+   elements. */
+#define SKIPLIST_MAX_LEVEL 16
+
+/* Skip-list index. */
+struct skiplist
+  {
+    struct list *list;          /* Indexed list. */
+    list_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+    int level_cnt;              /* Number of index levels in use. */
+    struct skiplist_node *heads[SKIPLIST_MAX_LEVEL]; /* First node per level. */
+    struct pool nodes;          /* Index nodes. */
+    unsigned seed;              /* Random state for node heights. */
+  };
+
+/* Basic life cycle. */
+void skiplist_init (struct skiplist *, struct list *,
+                    list_less_func *, void *aux);
+void skiplist_destroy (struct skiplist *);
+
+/* Insertion and removal. */
+void skiplist_insert (struct skiplist *, struct list_elem *);
+struct list_elem *skiplist_remove (struct skiplist *, struct list_elem *);
+
+/* Search. */
+struct list_elem *skiplist_find (struct skiplist *,
+                                 const struct list_elem *key);
+struct list_elem *skiplist_lower_bound (struct skiplist *,
+                                        const struct list_elem *key);
+struct list_elem *skiplist_upper_bound (struct skiplist *,
+                                        const struct list_elem *key);
+
+#endif /* skiplist.h */